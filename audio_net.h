@@ -19,9 +19,19 @@
 #ifndef Audio_Net_h_
 #define Audio_Net_h_
 
+// block size follows the Teensy Audio Library. Low latency builds set it for the core too, e.g. -DAUDIO_BLOCK_SAMPLES=32
+#ifndef AUDIO_BLOCK_SAMPLES
+	#define AUDIO_BLOCK_SAMPLES 128
+#endif
+static_assert(AUDIO_BLOCK_SAMPLES >= 16 && AUDIO_BLOCK_SAMPLES <= 128, "AUDIO_BLOCK_SAMPLES must be 16 .. 128");
+
 #include "stdio.h"  // for NULL
 #include <string.h> // for memcpy
-#include <queue>
+#include "spsc_queue.h"
+#include "slab_queue.h"
+#include "pkt_pool.h"
+#include "net_index.h"
+#include "net_config.h"
 #include "IPAddress.h"
 
 #include "audio_vban.h"
@@ -29,28 +39,45 @@
 #define USE_MDNS
 
 #define UDP_MAX_DATA			1464	// 
-#define SAMPLES_BUF				128		// Audio lib standard
+#define SAMPLES_BUF				AUDIO_BLOCK_SAMPLES		// Audio lib block
 //#define SERVICE_MAX_DATA 	255		// less than VBAN standard
 
-#define AUDIO_PKT_TIME 3		// 2.9 mS
+#define AUDIO_PKT_TIME 3		// 2.9 mS: a 128 sample frame. Timeouts are set by remote senders' frames, not our block size
 #define OK_PKT_TIME (AUDIO_PKT_TIME * 1000)	// allow subscription to streams that may not broadacst packets at full Audio Lib intervals 
 #define DEAD_STREAM_TIME (AUDIO_PKT_TIME * 2000)	// consider a stream dead if it doesn't send any packets
+#define DRIFT_SPAN_MIN 2000000		// uS of packets before a stream's clock drift is reported
+#define DRIFT_SPAN_MAX 1800000000	// then measured over a growing span, restarted after this long (uS)
+#define DRIFT_MAX_PPM 10000				// larger: the sender has restarted or changed rate
+#define STREAM_REBIND_FRAMES 8		// a subscription may move to another matching stream once its own has been quiet for this many of its frames ..
+#define STREAM_REBIND_MIN 300			// .. and at least this long (mS). See rebindTime()
 
 #define EOQ									-1 // end of queue marker
 
-/**************** default Queue and Structure sizing****************/
-#define MAX_AUDIO_QUEUE 12		// high water mark in an audio queue 
+#define MAX_NET_SAMPLE_RATE	96000	// highest incoming rate (see RS_MAX_RATIO). Outputs may also be converted down to 22050
+#define MIN_OUT_SAMPLE_RATE	22050
+
+/**************** Queue and Structure sizing****************/
+// set by the NetConfig traits struct (net_config.h)
+#define AUDIO_QUEUE_SAMPLES	NetConfig::audioQueueSamples	// high water mark in an audio queue (samples per channel)
+#define MAX_AUDIO_QUEUE 		audioQueuePkts<NetConfig>()		// the same, in packets of one audio block
 #define AUDIO_QUEUE_HIGH_WATER (MAX_AUDIO_QUEUE -1)
-#define MAX_UDP_STREAMS 		8 		// in or out
-#define MAX_REM_HOSTS				8			// hostname to IP matches
-#define MAX_SUBSCRIPTIONS		8			// may differ from STREAMS_IN
-#define MAX_SERVICE_QUEUE 32
+#define MAX_UDP_STREAMS 		NetConfig::streams			// in or out
+#define MAX_REM_HOSTS				NetConfig::hosts				// hostname to IP matches. Least recently seen host is replaced when full
+#define MAX_SUBSCRIPTIONS		NetConfig::subscriptions	// may differ from STREAMS_IN
+#define MAX_SERVICE_QUEUE 	NetConfig::serviceQueue
+#define PKT_QUEUE_LEN 			pktQueueLen<NetConfig>()	// queue capacity: output objects may push two packets past the high water mark
+#define PKT_POOL_SIZE 			pktPoolSize<NetConfig>()	// receive buffers shared by all input queues
+#define OUT_QUEUE_BYTES			NetConfig::outQueueBytes	// slab size for each output queue
+#define MAX_DESTINATIONS		4				// unicast (or group) destinations per audio output: subscribe() address + addDestination()
+#define PLC_HISTORY					512		// samples per channel kept by each input for loss concealment. Power of 2
+#define RESAMPLE_BUF				320		// input samples per channel held by each input's rate converter: a block at up to 2.2x, plus the filter
+#define REORDER_MAX					4			// most frames an audio packet may arrive late and still be put back in order
+#define REORDER_WINDOW			2			// default reorder window (frames). 0: deliver in arrival order
 
 // assumes 16 bit samples
-#define MAXCHANNELS 8			// currrently only 2 channels implemented
-#define CHANS_2_PKTS	6		// for 6 or more channels, we need two VBAN output packets
+#define MAXCHANNELS 				NetConfig::maxChannels
 #define BYTES_SAMPLE 2
-#define AUDIO_BLOCK_SAMPLES 128
+#define CHANS_2_PKTS	(VBAN_MAX_DATA / (AUDIO_BLOCK_SAMPLES * BYTES_SAMPLE) + 1)	// this many channels or more need two VBAN output packets per block (6 for 128 samples)
 //#define BLOX_SEC 345		// 2.9mS bocks per second
 #define SAMPLES_2 (AUDIO_BLOCK_SAMPLES * BYTES_SAMPLE) // samples in a stereo stream
 #define TARGET_BCAST 255	// remoteHostID for broadcast streams and packets
@@ -68,24 +95,47 @@ struct streamInfo
 { 
 	vban_header hdr;									// 28 bytes (VBAN)
 	IPAddress 	remoteIP;							// Remote host for input streams. Target for output streams 
+	streamKey		key;									// streamsIn: (remoteIP, name) registry key
 	uint32_t 		lastPktTime = 0;			// mS stored on each received packet - stream deactivation not implemented
+	uint32_t		arrivalUs = 0;				// streamsIn: uS when the last packet was queued
+	uint32_t		frameUs = 0;					// streamsIn: uS when frame hdr.nuFrame (the newest) arrived
+	uint32_t		jitterUs = 0;					// streamsIn: inter-arrival jitter estimate (RFC 3550 style)
+	uint32_t		rateUs = 0;						// streamsIn: start of the clock drift measurement (uS) ..
+	uint32_t		rateFrame = 0;				// .. and its nuFrame
+	int32_t			driftPpm = 0;					// streamsIn: sender's sample clock against ours, parts per million
 	int16_t 		hostIndx = EOQ;				// index into hostInfo table (streamsOut: unused)
   int16_t 		subscription = EOQ; 	// index into subscription table. Dump packets when EOQ (streamsOut: unused)
 	int8_t			type;	// see pktType
 	bool 				active = 0;						// this is a record with valid data
 };
 
+// an audio output's destinations. Each packet is built once and sent to all of them (sendPkts())
+struct netDest
+{
+	IPAddress	ip;
+	uint32_t	sent = 0;			// packets sent
+	uint32_t	failed = 0;		// sends the network stack refused (the packet is retried)
+};
+
+struct destList
+{
+	netDest	dest[MAX_DESTINATIONS];
+	uint8_t	count = 0;
+	uint8_t	next = 0;				// destination due for the packet at the front of the queue
+};
+
 // host to IP matching - from incoming SERVICE : ID packets
 struct hostInfo
 {
 	IPAddress remoteIP;
 	uint32_t lastPinged = 0;
+	uint32_t lastSeen = 0;		// mS, last packet from this host
 	char hostName[VBAN_HOSTNAME_LEN] = "*";
 	bool active = false;
 };
 
 /**************** QUEUE PACKETS ****************/
-// Uses std::queue
+// Uses SPSCQueue (spsc_queue.h): one producer, one consumer, no interrupt masking
 // All protocols are queued with the same packet structure 
 #define QPKT_HDR_SIZE (VBAN_HDR_SIZE + 4)
 struct alignas(int) queuePkt
@@ -99,23 +149,45 @@ struct alignas(int) queuePkt
 		int16_t content16[VBAN_MAX_DATA/2];	// easier access to audio samples
 	} c;
 };
+// output queues hold packets at their real length (QPKT_HDR_SIZE + content) in a slab. See slab_queue.h
+typedef SlabQueue<queuePkt, OUT_QUEUE_BYTES> pktQueue;
+
+// incoming packets live in the receive pool (etherTran.rxPool). Input queues only hold pointers to pool slots.
+// The consumer must rxPool.release() a slot once it has finished with it.
+typedef queuePkt * pktHandle;
+typedef SPSCQueue<pktHandle, PKT_QUEUE_LEN> pktHandleQueue;
+typedef PktPool<queuePkt, PKT_POOL_SIZE> pktPool;
 
 // subscriptions may be made before the stream is present
 // queue & pointer is assigned by subscriber
-// housekeeping (control_ethernet::update() )regularly matches active streams to subscriptions
+// streams are bound to subscriptions as they appear (see AudioControlEtherTransport::subMatches()). Housekeeping is a backstop.
 // if neither ipAddress or hostname is provided, any host's matching streamName will work
+// a multicast subscription joins group and takes the stream from any host
 struct subscription {
-	std::queue <queuePkt> *qPtr = (std::queue <queuePkt> *)nullptr;
+	pktHandleQueue *qPtr = (pktHandleQueue *)nullptr;
 	int				maxQ;										// current queue
 	IPAddress	ipAddress;	
+	IPAddress	group;									// multicast group joined for this subscription. 0: none
 	char			streamName[VBAN_STREAM_NAME_LENGTH];
 	char			hostName[VBAN_HOSTNAME_LEN] ="?"; 
 	int8_t		protocol = EOQ;	// see format_SR
 	int8_t		serviceType = EOQ; // format_nbc for Service/Text/Serial pkts
 	int8_t		streamID = EOQ;
 	bool			active = false; 
+	bool			compressed = false;	// accept NET_FMT_COMPRESSED frames (codec_net.h)
+	// reorder window - audio packets are delivered to qPtr in nuFrame order. updateNet() only
+	pktHandle	held[REORDER_MAX] = {nullptr};	// early packets waiting for a missing frame, by nuFrame % REORDER_MAX
+	uint32_t	nextFrame = 0;				// next nuFrame due
+	uint8_t		reorderWindow = REORDER_WINDOW;
+	uint8_t		heldCount = 0;
+	bool			seqValid = false;			// nextFrame is set
+	uint32_t	reordered = 0;				// late packets put back in order
+	uint32_t	tooLate = 0;					// arrived after their frame had been given up
 };
 
+// 224.0.0.0 - 239.255.255.255
+inline bool isMulticastIP(IPAddress ip) { return (ip[0] & 0xF0) == 0xE0; }
+
 // pretty VBAN header for end-user information (constructed as needed)
 // see getStreamInfo()
 #define STREAM_NAME_LEN 16
@@ -123,6 +195,7 @@ struct stream_pretty{
 	uint32_t	sampleRate;
 	uint32_t	lastPktTime;
 	uint32_t	pktsInQueue = 0;
+	int32_t		driftPpm = 0;		// sender's sample clock against ours (inputs)
 	uint16_t	pktSamples;
 	uint16_t 	channels;
 	uint8_t 	protocol; 
@@ -135,6 +208,19 @@ struct stream_pretty{
 	bool			active = 0; 
 };
 
+// static RAM used by the transport, the receive pool and the object queues for configuration C,
+// with every stream and subscription in use
+template <typename C>
+constexpr uint32_t netRamFootprint(void)
+{
+	return sizeof(streamInfo) * C::streams * 2
+		+ sizeof(hostInfo) * C::hosts
+		+ sizeof(subscription) * C::subscriptions
+		+ sizeof(queuePkt) * pktPoolSize<C>()
+		+ (sizeof(SPSCQueue<pktHandle, pktQueueLen<C>()>) + sizeof(int16_t) * C::maxChannels * (PLC_HISTORY + RESAMPLE_BUF)) * C::subscriptions	// input objects: queue, concealment history and rate converter
+		+ sizeof(SlabQueue<queuePkt, C::outQueueBytes>) * C::streams;				// output objects
+}
+
 enum pktType  {PKT_NOT_CONSUMED, PKT_AUDIO, PKT_SERIAL, PKT_MIDI, PKT_TEXT, PKT_SERVICE, PKT_PING, PKT_CHAT};
 
 //#define GET_FIRST_BLOCK -1 // getNextInQueue
@@ -84,11 +84,12 @@ extern uint32_t VBAN_AUDIO_SRList[VBAN_AUDIO_SR_MAXNUMBER];
 enum VBAN_AUDIO_dataType {BYTE8, INT16, INT24, INT32, FLOAT32, FLOAT64, BITS12, BITS10};
 extern char VBAN_AUDIO_dataType_name[VBAN_AUDIO_TYPE_MAXNUMBER][8];
 // 4 MSBs: CODEC (only PCM is implemented here)
-#define VBAN_AUDIO_CODEC_MAXNUMBER 	3
+#define VBAN_AUDIO_CODEC_MAXNUMBER 	16
 #define VBAN_AUDIO_CODEC_MASK				0xf0
 #define VBAN_AUDIO_CODEC_SHIFT 			4
 		
 enum VBAN_AUDIO_codec {PCM = 0, VBCA = 0x10, VBCV = 0x20}; // the rest are undefined
+#define VBAN_CODEC_USER							0xF0	// user defined: compressed Teensy to Teensy frames (codec_net.h)
 extern char VBAN_AUDIO_CODEC_name[VBAN_AUDIO_CODEC_MAXNUMBER][5];
 // format_bit:
 #define OK_VBAN_FMT (INT16 + PCM)	//  INT16 + PCM format_bit
@@ -0,0 +1,164 @@
+/*
+ * EtherBackend
+ * Network (UDP datagram) backends for AudioControlEtherTransport
+ *
+ * This file should not be included in user code. Include control_ethernet.h instead.
+ *
+ * AudioControlEtherTransport only talks to the network through this interface, so the whole
+ * receive / queue / transmit pipeline can be run on top of:
+ *	EtherBackendQNE				QNEthernet on a Teensy 4.1 (default on Teensy)
+ *	EtherBackendPosix			Linux / POSIX UDP sockets (default on host builds) - for profiling and load testing
+ *	EtherBackendLoopback	In-memory datagram queue. Sent packets are received again, test traffic can be injected.
+ *
+ * Select a backend with etherTran.setBackend() before AudioControlEthernet::begin().
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "IPAddress.h"
+#include "audio_vban.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+	#define CE_BACKEND_POSIX		// host build: no QNEthernet
+#else
+	#define CE_BACKEND_QNE
+#endif
+
+#define LOOPBACK_QUEUE		16			// datagrams held by EtherBackendLoopback
+#define BACKEND_MAX_PKT		(VBAN_HDR_SIZE + VBAN_MAX_DATA)	// largest VBAN datagram
+
+// Interface used by AudioControlEtherTransport
+// parsePacket(), data(), size() and remoteIP() follow QNEthernet EthernetUDP semantics:
+// parsePacket() discards the current datagram and makes the next one current.
+class EtherBackend
+{
+public:
+	virtual bool begin(uint16_t port, const char *hostName) = 0; // bring up the link and listen on port
+	virtual bool linkState(void) = 0;
+	virtual IPAddress localIP(void) = 0;
+	virtual void macAddress(uint8_t *mac) { memset(mac, 0, 6); }
+	virtual int hardwareStatus(void) { return 0; }
+	virtual void poll(void) { }	// run the network stack, if it needs to be run from updateNet()
+
+	// receive
+	virtual int parsePacket(void) = 0;						// size of the next waiting datagram. <= 0 if none
+	virtual const uint8_t *data(void) = 0;				// current datagram
+	virtual int size(void) = 0;
+	virtual IPAddress remoteIP(void) = 0;
+	virtual int receiveQueueSize(void) { return 0; }			// datagrams waiting, if known
+	virtual uint32_t droppedReceiveCount(void) { return 0; }
+
+	// transmit
+	virtual bool send(IPAddress remoteIP, uint16_t port, const uint8_t *data, int len) = 0;
+
+	// multicast group membership (IGMP). Datagrams sent to a joined group arrive on the listening port
+	virtual bool joinGroup(IPAddress) { return false; }
+	virtual bool leaveGroup(IPAddress) { return false; }
+};
+
+#ifdef CE_BACKEND_QNE
+// QNEthernet: DHCP, MDNS and a single EthernetUDP listener
+class EtherBackendQNE : public EtherBackend
+{
+public:
+	bool begin(uint16_t port, const char *hostName);
+	bool linkState(void);
+	IPAddress localIP(void);
+	void macAddress(uint8_t *mac);
+	int hardwareStatus(void);
+	void poll(void);
+
+	int parsePacket(void);
+	const uint8_t *data(void);
+	int size(void);
+	IPAddress remoteIP(void);
+	int receiveQueueSize(void);
+	uint32_t droppedReceiveCount(void);
+
+	bool send(IPAddress remoteIP, uint16_t port, const uint8_t *data, int len);
+	bool joinGroup(IPAddress group);
+	bool leaveGroup(IPAddress group);
+};
+#endif
+
+#ifdef CE_BACKEND_POSIX
+// non-blocking UDP socket bound to INADDR_ANY
+// ifName selects the interface used for localIP() (and so the broadcast address). First non-loopback IPv4 interface if null.
+class EtherBackendPosix : public EtherBackend
+{
+public:
+	EtherBackendPosix(const char *ifName = nullptr) : _ifName(ifName) { }
+	~EtherBackendPosix();
+
+	bool begin(uint16_t port, const char *hostName);
+	bool linkState(void) { return _sock >= 0; }
+	IPAddress localIP(void);
+
+	int parsePacket(void);
+	const uint8_t *data(void) { return _buf; }
+	int size(void) { return _size; }
+	IPAddress remoteIP(void) { return _remoteIP; }
+	int receiveQueueSize(void);		// 0 or 1: the socket only reports whether a datagram is waiting
+	uint32_t droppedReceiveCount(void) { return _dropped; }
+
+	bool send(IPAddress remoteIP, uint16_t port, const uint8_t *data, int len);
+	bool joinGroup(IPAddress group);
+	bool leaveGroup(IPAddress group);
+
+private:
+	bool membership(IPAddress group, int option);
+	const char *_ifName;
+	int _sock = -1;
+	int _size = 0;
+	uint32_t _dropped = 0;
+	IPAddress _remoteIP;
+	alignas(4) uint8_t _buf[BACKEND_MAX_PKT]; // VBAN headers are read in place
+};
+#endif
+
+// Every packet sent is queued for reception, as if from localIP(). Multicast groups are always joined.
+// inject() queues a datagram from any remote host - used to drive the transport from test or load generating code.
+class EtherBackendLoopback : public EtherBackend
+{
+public:
+	EtherBackendLoopback(IPAddress myIP = IPAddress(127, 0, 0, 1)) : _myIP(myIP) { }
+
+	bool begin(uint16_t, const char *) { _begun = true; return true; }
+	bool linkState(void) { return _begun; }
+	IPAddress localIP(void) { return _myIP; }
+
+	int parsePacket(void);
+	const uint8_t *data(void) { return _cur.data; }
+	int size(void) { return _cur.len; }
+	IPAddress remoteIP(void) { return _cur.remoteIP; }
+	int receiveQueueSize(void) { return _count; }
+	uint32_t droppedReceiveCount(void) { return _dropped; }
+
+	bool send(IPAddress remoteIP, uint16_t port, const uint8_t *data, int len);
+	bool inject(IPAddress fromIP, const uint8_t *data, int len);	// queue an incoming datagram
+	bool joinGroup(IPAddress) { return true; }
+	bool leaveGroup(IPAddress) { return true; }
+	uint32_t sentCount(void) { return _sent; }
+
+private:
+	struct loopPkt
+	{
+		IPAddress remoteIP;
+		int len = 0;
+		alignas(4) uint8_t data[BACKEND_MAX_PKT];
+	};
+	IPAddress _myIP;
+	bool _begun = false;
+	loopPkt _q[LOOPBACK_QUEUE];
+	loopPkt _cur;			// current datagram (parsePacket)
+	int _head = 0;
+	int _count = 0;
+	uint32_t _dropped = 0;
+	uint32_t _sent = 0;
+};
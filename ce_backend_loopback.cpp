@@ -0,0 +1,55 @@
+/*
+ * EtherBackendLoopback
+ * In-memory datagram backend for AudioControlEtherTransport
+ * No network hardware is used: everything sent is received again, and test code may inject() traffic from any host.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include "ce_backend.h"
+
+// make the oldest queued datagram current
+int EtherBackendLoopback::parsePacket(void)
+{
+	if(_count == 0)
+	{
+		_cur.len = 0;
+		return 0;
+	}
+	loopPkt &p = _q[_head];
+	_cur.remoteIP = p.remoteIP;
+	_cur.len = p.len;
+	memcpy(_cur.data, p.data, p.len);
+	_head = (_head + 1) % LOOPBACK_QUEUE;
+	_count--;
+	return _cur.len;
+}
+
+bool EtherBackendLoopback::inject(IPAddress fromIP, const uint8_t *data, int len)
+{
+	if(len <= 0 || len > BACKEND_MAX_PKT)
+		return false;
+	if(_count >= LOOPBACK_QUEUE) // full - drop, as a real receive queue would
+	{
+		_dropped++;
+		return false;
+	}
+	loopPkt &p = _q[(_head + _count) % LOOPBACK_QUEUE];
+	p.remoteIP = fromIP;
+	p.len = len;
+	memcpy(p.data, data, len);
+	_count++;
+	return true;
+}
+
+// all destinations (unicast or broadcast) loop back to this host
+bool EtherBackendLoopback::send(IPAddress, uint16_t, const uint8_t *data, int len)
+{
+	if(!_begun)
+		return false;
+	_sent++;
+	inject(_myIP, data, len);
+	return true; // sent, even if nobody had room to receive it
+}
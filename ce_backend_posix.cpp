@@ -0,0 +1,157 @@
+/*
+ * EtherBackendPosix
+ * Linux / POSIX UDP socket backend for AudioControlEtherTransport
+ * Runs the receive, queue and transmit pipeline on a host for profiling and load testing.
+ *
+ * Host builds need the usual Arduino shims (IPAddress, millis(), Serial) for the rest of the library.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include "ce_backend.h"
+
+#ifdef CE_BACKEND_POSIX
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+EtherBackendPosix::~EtherBackendPosix()
+{
+	if(_sock >= 0)
+		close(_sock);
+}
+
+bool EtherBackendPosix::begin(uint16_t port, const char *) // no MDNS on the host
+{
+	if(_sock >= 0)
+		return true;
+	_sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if(_sock < 0)
+	{
+		perror("EtherBackendPosix: socket");
+		return false;
+	}
+	int on = 1;
+	setsockopt(_sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	setsockopt(_sock, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on)); // VBAN PING and broadcast streams
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if(bind(_sock, (sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		perror("EtherBackendPosix: bind");
+		close(_sock);
+		_sock = -1;
+		return false;
+	}
+	unsigned char ttl = 1;	// multicast stays on the local segment
+	setsockopt(_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+	in_addr ifAddr;
+	ifAddr.s_addr = (uint32_t)localIP();
+	if(ifAddr.s_addr != 0)
+		setsockopt(_sock, IPPROTO_IP, IP_MULTICAST_IF, &ifAddr, sizeof(ifAddr)); // send groups out of the chosen interface
+	fcntl(_sock, F_SETFL, fcntl(_sock, F_GETFL, 0) | O_NONBLOCK); // parsePacket() must not block updateNet()
+	return true;
+}
+
+// IPAddress and in_addr both hold the address in network byte order
+IPAddress EtherBackendPosix::localIP(void)
+{
+	IPAddress ip((uint32_t)0);
+	ifaddrs *ifList;
+	if(getifaddrs(&ifList) < 0)
+		return ip;
+	for(ifaddrs *ifa = ifList; ifa != nullptr; ifa = ifa->ifa_next)
+	{
+		if(ifa->ifa_addr == nullptr || ifa->ifa_addr->sa_family != AF_INET)
+			continue;
+		if(_ifName ? strcmp(ifa->ifa_name, _ifName) != 0 : (ifa->ifa_flags & IFF_LOOPBACK) != 0)
+			continue;
+		ip = IPAddress((uint32_t)((sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr);
+		break;
+	}
+	freeifaddrs(ifList);
+	return ip;
+}
+
+int EtherBackendPosix::parsePacket(void)
+{
+	_size = 0;
+	if(_sock < 0)
+		return 0;
+	sockaddr_in from;
+	socklen_t fromLen = sizeof(from);
+	int len = recvfrom(_sock, _buf, sizeof(_buf), MSG_TRUNC, (sockaddr *)&from, &fromLen);
+	if(len < 0)
+		return 0; // EAGAIN: nothing waiting
+	if(len > (int)sizeof(_buf)) // oversize datagram - not VBAN
+	{
+		_dropped++;
+		return 0;
+	}
+	_remoteIP = IPAddress((uint32_t)from.sin_addr.s_addr);
+	_size = len;
+	return _size;
+}
+
+int EtherBackendPosix::receiveQueueSize(void)
+{
+	int bytes = 0;
+	if(_sock < 0 || ioctl(_sock, FIONREAD, &bytes) < 0)
+		return 0;
+	return (bytes > 0) ? 1 : 0;
+}
+
+bool EtherBackendPosix::send(IPAddress remoteIP, uint16_t port, const uint8_t *data, int len)
+{
+	if(_sock < 0)
+		return false;
+	sockaddr_in to;
+	memset(&to, 0, sizeof(to));
+	to.sin_family = AF_INET;
+	to.sin_addr.s_addr = (uint32_t)remoteIP;
+	to.sin_port = htons(port);
+	return sendto(_sock, data, len, 0, (sockaddr *)&to, sizeof(to)) == len;
+}
+
+// membership is per interface: the one localIP() reports (INADDR_ANY: the kernel's choice)
+bool EtherBackendPosix::membership(IPAddress group, int option)
+{
+	if(_sock < 0)
+		return false;
+	ip_mreq mreq;
+	mreq.imr_multiaddr.s_addr = (uint32_t)group;
+	mreq.imr_interface.s_addr = (uint32_t)localIP();
+	if(setsockopt(_sock, IPPROTO_IP, option, &mreq, sizeof(mreq)) < 0)
+	{
+		perror("EtherBackendPosix: multicast membership");
+		return false;
+	}
+	return true;
+}
+
+bool EtherBackendPosix::joinGroup(IPAddress group)
+{
+	return membership(group, IP_ADD_MEMBERSHIP);
+}
+
+bool EtherBackendPosix::leaveGroup(IPAddress group)
+{
+	return membership(group, IP_DROP_MEMBERSHIP);
+}
+
+#endif
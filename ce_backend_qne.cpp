@@ -0,0 +1,154 @@
+/*
+ * EtherBackendQNE
+ * QNEthernet backend for AudioControlEtherTransport  https://github.com/ssilverman/QNEthernet
+ * Ethernet start up (DHCP, MDNS) and UDP datagram traffic
+ *
+ * Relies on QNEthernet library for Teensy 4.1 Shawn Silverman
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include "ce_backend.h"
+
+#ifdef CE_BACKEND_QNE
+
+#include <Arduino.h>
+#include <QNEthernet.h>
+#include "control_ethernet.h" // DHCP_TIMEOUT, QN_PKT_QUEUE
+
+using namespace qindesign::network;
+
+EthernetUDP udp{QN_PKT_QUEUE}; // global so user code can reach it (see README: Debugging)
+
+// start or restart network services
+// *** active restart handling disabled for now ***
+bool EtherBackendQNE::begin(uint16_t port, const char *hostName)
+{
+	if(!Ethernet.begin())
+	{
+		Serial.println("EtherStart: Failed to start Ethernet");
+		return false;
+	}
+
+	if (!Ethernet.waitForLocalIP(DHCP_TIMEOUT)) {
+    printf("EtherStart: Failed to get IP address from DHCP\r\n");
+    return false;
+  }
+
+	if(!Ethernet.linkState()) 
+	{
+		Serial.println("EtherStart: Ethernet link is not yet active...");
+		return false;
+  }
+
+#ifdef USE_MDNS
+	#ifdef CE_DEBUG
+		Serial.printf("MDNS starting with hostname '%s.local'\n", hostName);
+	#endif
+	if(!MDNS.begin(hostName))
+	{
+		 Serial.println("ERROR: Starting mDNS.");
+		 return false;
+	} else {
+    if (!MDNS.addService("_osc", "_udp", port)) {
+      Serial.println("ERROR: Adding MDNS responder service.");
+			return false;
+    } else {
+	#ifdef CE_DEBUG
+			Serial.printf("Started mDNS service:\r\n"
+										"    Name: %s\r\n"
+										"    Type: _osc._udp\r\n"
+										"    Port: %u\r\n",
+										hostName, port);
+	#endif
+    }
+  }
+#endif
+
+	// don't start listening to the UDP port until ready to process packets (see updateNet()
+#ifdef CE_DEBUG
+		Serial.printf("UDP will listen on port %i\n", port);
+#endif
+	if(!udp.begin(port))
+	{
+		Serial.println("Failed to start UDP listener");
+	}
+	return true;
+}
+
+bool EtherBackendQNE::linkState(void)
+{
+	return Ethernet.linkState();
+}
+
+IPAddress EtherBackendQNE::localIP(void)
+{
+	return Ethernet.localIP();
+}
+
+void EtherBackendQNE::macAddress(uint8_t *mac)
+{
+	Ethernet.macAddress(mac); // reads rather than setting
+}
+
+int EtherBackendQNE::hardwareStatus(void)
+{
+	return Ethernet.hardwareStatus();
+}
+
+// Ethernet.loop() is also run from yield() unless QNETHERNET_DO_LOOP_IN_YIELD is disabled.
+// Running it here as well keeps all stack activity inside updateNet(), which paced transmit relies on.
+void EtherBackendQNE::poll(void)
+{
+	Ethernet.loop();
+}
+
+int EtherBackendQNE::parsePacket(void)
+{
+	return udp.parsePacket();
+}
+
+const uint8_t *EtherBackendQNE::data(void)
+{
+	return udp.data();
+}
+
+int EtherBackendQNE::size(void)
+{
+	return udp.size();
+}
+
+IPAddress EtherBackendQNE::remoteIP(void)
+{
+	return udp.remoteIP();
+}
+
+int EtherBackendQNE::receiveQueueSize(void)
+{
+	return udp.receiveQueueSize();
+}
+
+uint32_t EtherBackendQNE::droppedReceiveCount(void)
+{
+	return udp.droppedReceiveCount();
+}
+
+bool EtherBackendQNE::send(IPAddress remoteIP, uint16_t port, const uint8_t *data, int len)
+{
+	return udp.send(remoteIP, port, data, len);
+}
+
+// QNEthernet keeps one IGMP membership per group. The UDP listener receives the group's datagrams
+bool EtherBackendQNE::joinGroup(IPAddress group)
+{
+	return Ethernet.joinGroup(group);
+}
+
+bool EtherBackendQNE::leaveGroup(IPAddress group)
+{
+	return Ethernet.leaveGroup(group);
+}
+
+#endif
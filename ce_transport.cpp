@@ -2,7 +2,7 @@
  * Ethernet (UDP) Network Control object for Teensy Audio Library
  * This file handles low level communications management, interface setup and all Datagram traffic
  * Handles all Network-side queue management (ce_transport_queues.hpp)
- * All audio queue manipulation must be with **interrupts off**
+ * Audio queues are lock-free SPSC rings (spsc_queue.h): no interrupt masking is needed
  *
  * Relies on QNEthernet library for Teensy 4.1 Shawn Silverman
  *
@@ -15,13 +15,15 @@
 #include <Arduino.h>
 #include "control_ethernet.h"
 #include "ce_transport.h"
-#include <QNEthernet.h>
-
-
-using namespace qindesign::network;
 
 AudioControlEtherTransport etherTran; 
 
+#ifdef CE_BACKEND_POSIX
+static EtherBackendPosix defaultBackend;
+#else
+static EtherBackendQNE defaultBackend;
+#endif
+
 #if defined CTRL_ETHERNET_DO_LOOP_IN_YIELD
 	#if defined(__has_include)
 		#if __has_include(<EventResponder.h>)
@@ -44,7 +46,13 @@ AudioControlEtherTransport etherTran;
 	#endif  // defined(__has_include)
 #endif  // QNETHERNET_DO_LOOP_IN_YIELD
 
-EthernetUDP udp{QN_PKT_QUEUE};
+#ifndef DMAMEM
+#define DMAMEM
+#endif
+
+static_assert(netRamFootprint<NetConfig>() <= NetConfig::ramBudget, "NET_CONFIG needs more RAM than its ramBudget");
+
+DMAMEM static queuePkt rxPoolSlots[PKT_POOL_SIZE]; // Teensy RAM2 - not needed in tightly coupled memory
 
 // debug
 int pkts = 0;
@@ -63,10 +71,15 @@ bool AudioControlEtherTransport::begin()
 	printMe = false;
 	if(!_udpPort)
 	_udpPort = VBAN_UDP_PORT;
+	if(net == nullptr)
+		net = &defaultBackend;
 
 #ifdef CE_DEBUG
 	Serial.print("CE: BEGIN ");
 #endif
+	rxPool.begin(rxPoolSlots);
+	rebuildStreamIndex();
+	rebuildHostIndex();
 	initQueues(); // before packets start appearing
 	
 	// start the execution of updateNet() on yield() and delay()
@@ -89,7 +102,14 @@ bool AudioControlEtherTransport::begin()
 // should we process packets?
 bool AudioControlEtherTransport::linkIsUp(void) 
 { 
-	return (etherTran.etherTranBegun && Ethernet.linkState()); // begin() has been successful and still connected 
+	return (etherTran.etherTranBegun && net->linkState()); // begin() has been successful and still connected 
+}
+
+// select the network backend. Ignored once begin() has been called
+void AudioControlEtherTransport::setBackend(EtherBackend *backend)
+{
+	if(!etherTranBegun && backend != nullptr)
+		net = backend;
 }
 
 // start or restart network services
@@ -97,89 +117,32 @@ bool AudioControlEtherTransport::linkIsUp(void)
 bool AudioControlEtherTransport::etherStart(void) 
 { 
 	//static bool udpBegun = false; // static needed if restart calls this code
-	//static bool MDNSbegun = false;
-  //static bool etherBegun = false;
-	bool myLinkOn; 
 #ifdef CE_DEBUG
   Serial.println("----> EtherStart");
 #endif
+	strcpy(_FQDN, _VBANhostName);
+	strcat(_FQDN, ".local");
 
-	if(!Ethernet.begin())
-	{
-		Serial.println("EtherStart: Failed to start Ethernet");
-		myLinkOn = false;
+	// Ethernet, DHCP, MDNS and UDP listener (port _udpPort) are the backend's job
+	if(!net->begin(_udpPort, _VBANhostName))
 		return false;
-	}
-	//else
-	//	etherBegun = true;
 
-	if (!Ethernet.waitForLocalIP(DHCP_TIMEOUT)) {
-    printf("EtherStart: Failed to get IP address from DHCP\r\n");
-    return false;
-  }
-	 Ethernet.macAddress(_myMAC); // reads rather than setting 
-	 updateIP();
+	net->macAddress(_myMAC); // reads rather than setting 
+	updateIP();
+	joinGroups();
 
 	Serial.println(_myIP);
 	Serial.println(_myBroadcastIP);
 
-  myLinkOn = Ethernet.linkState(); 
-//  ethernetEnabled = myLinkOn;	
-	if(!myLinkOn) 
-	{
-		Serial.println("EtherStart: Ethernet link is not yet active...");
-		return false;
-  }
-
-#ifdef USE_MDNS
-	strcpy(_FQDN, _VBANhostName);
-	strcat(_FQDN, ".local");
-	#ifdef CE_DEBUG
-		Serial.printf("MDNS starting with hostname '%s'\n", _FQDN);
-	#endif
-	if(!MDNS.begin(_VBANhostName))
-	{
-		 Serial.println("ERROR: Starting mDNS.");
-		 return false;
-	} else {
-    if (!MDNS.addService("_osc", "_udp", _udpPort)) {
-      Serial.println("ERROR: Adding MDNS responder service.");
-			return false;
-    } else {
-			//MDNSbegun = true;
-	#ifdef CE_DEBUG
-			Serial.printf("Started mDNS service:\r\n"
-										"    Name: %s\r\n"
-										"    Type: _osc._udp\r\n"
-										"    Port: %u\r\n",
-										_VBANhostName, _udpPort);
-	#endif
-    }
-  }
-	//Serial.printf("MDNS hostname is '%s'\n", MDNS.hostname() );
-	//Serial.printf("MDNS is %srunning \n",((bool)MDNS) ? "" : "not ");
-#endif
-
-	// don't start listening to the UDP port until ready to process packets (see updateNet()
-#ifdef CE_DEBUG
-		Serial.printf("UDP will listen on port %i\n", etherTran._udpPort);
-#endif
-	if(!udp.begin(etherTran._udpPort))
-	{
-		Serial.println("Failed to start UDP listener");
-	}
-	//else
-	//	udpBegun = true;
-	myLinkOn = Ethernet.linkState(); 
 #ifdef CE_DEBUG
-	Serial.printf("CE: etherStart complete. Status = '%s'\n", (myLinkOn ) ? "Conn" : "Not Conn"); 
+	Serial.printf("CE: etherStart complete. Status = '%s'\n", (net->linkState()) ? "Conn" : "Not Conn"); 
 #endif
  return true;
 }
 
 void AudioControlEtherTransport::updateIP(void)
 {
-	_myIP = Ethernet.localIP();
+	_myIP = net->localIP();
 	_myBroadcastIP = _myIP;
 	_myBroadcastIP[3] = 255;
 }
@@ -187,13 +150,23 @@ void AudioControlEtherTransport::updateIP(void)
 /* There is no regular update() function as this is not an AudioStream object
  * DO NOT call yield() or delay() from here or any routine called from this function
  * updateNet() is called transparently from yield(), delay() and at end of each mainline code execution, see addYieldFunction() above
- * 	Process any incoming UDP packets. ***Blocks*** until all queued packets are processed
- * 	Periodically perform host, stream and subscription housekeeping
+ * 	Process incoming UDP packets until none are waiting or the work budget (setNetBudget()) is used up.
+ * 	Anything left waits in the network stack for the next call.
+ * 	Periodically perform host, stream and subscription housekeeping, one step per call
 */
 
+// updateNet() and sendPing() hold netBusy while they use the backend, so paceTx() (interrupt context) keeps out
+struct netBusyGuard
+{
+	bool was;
+	netBusyGuard() { was = etherTran.netBusy; etherTran.netBusy = true; }
+	~netBusyGuard() { etherTran.netBusy = was; }
+};
+
 static void updateNet(void) //AudioControlEtherTransport::
 {
 	//static uint32_t lastUpdateNet;
+	uint32_t startUs = micros();
 	static int udpDiscardedPackets = 0;
 	static uint32_t lastHousekeeping;	
 
@@ -203,6 +176,8 @@ static void updateNet(void) //AudioControlEtherTransport::
 	
 	if(!etherTran.etherTranBegun) // no processing until after begin() completes
 		return;
+	netBusyGuard busy;
+	etherTran.net->poll();
 		
 	etherTran.printMe = false; // 
 	//etherTran.eprintMe = false;
@@ -220,7 +195,7 @@ static void updateNet(void) //AudioControlEtherTransport::
 		return; // abort further processing while link is down
 		// *** abort any attempt to actively reconnect for now
 #ifdef CE_DEBUG
-		if(etherTran.printMe) Serial.printf("No ethernet link begun %i, state %i\n", etherTran.etherTranBegun, Ethernet.linkState());
+		if(etherTran.printMe) Serial.printf("No ethernet link begun %i, state %i\n", etherTran.etherTranBegun, etherTran.net->linkState());
 #endif
 		// try to reconnect if last try was long enough ago
 		if((millis() - lastLinkTestTime) > DISCONNECT_RETRY)
@@ -236,18 +211,18 @@ static void updateNet(void) //AudioControlEtherTransport::
 
 //if(etherTran.printMe) Serial.println("UN: process pkts");
 	// dump packets from overlong input queues
-	int udpQLen = udp.receiveQueueSize();
+	int udpQLen = etherTran.net->receiveQueueSize();
 	while(udpQLen >= QN_PKT_QUEUE)
 	{
 #ifdef CE_DEBUG
 		Serial.printf("********UDP queue is full %i, popping one\n", udpQLen);
 #endif
-		udp.parsePacket();
-		udpQLen = udp.receiveQueueSize();
+		etherTran.net->parsePacket();
+		udpQLen = etherTran.net->receiveQueueSize();
 		udpDiscardedPackets++;
 	}
 
-	int updDP = udp.droppedReceiveCount();
+	int updDP = etherTran.net->droppedReceiveCount();
 	
 	if(updDP > (etherTran.udpDroppedPkts + 50))
 	{
@@ -257,20 +232,29 @@ static void updateNet(void) //AudioControlEtherTransport::
 		etherTran.udpDroppedPkts = updDP + 50;
 	}
 
-	int pktSize = udp.parsePacket();
-
-	while(pktSize >= VBAN_HDR_SIZE) // queue any consumable VBAN packets
+	// at least one packet per call, so a small budget spreads the work rather than letting the stack's queue overflow
+	int processed = 0;
+	uint32_t rxStartUs = micros();
+	while(true) // queue any consumable VBAN packets
 	{
+		if(processed > 0 && etherTran.overBudget(processed, rxStartUs)) // leave the rest in the network stack's queue
+		{
+			if(etherTran.net->receiveQueueSize() > 0)
+				etherTran.budgetHits++;
+			break;
+		}
+		int pktSize = etherTran.net->parsePacket(); // next waiting UDP packet
+		if(pktSize <= 0)
+			break;
+		processed++; // runts cost a parse too
+		if(pktSize < VBAN_HDR_SIZE) // runt - not VBAN
+			continue;
 		etherTran.VBpktsProc++;
 	//	etherTran.printMe = (etherTran.VBpktsProc % 500 == 0) && (millis() > 4000);	
 		
-		const uint8_t *UDPdata = udp.data();
+		// triage in place. The datagram is only copied if it is queued (addPacketToQueue)
+		const vban_header *hdr = (const vban_header *)etherTran.net->data();
 		
-		vban_header hdr;	// ******************* could use pointer here
-		memcpy((void*)&hdr, (void*)UDPdata, sizeof(vban_header));
-		
-		//const unsigned char *dptr;
-	//	vban_ping vbp;
 		pktType pktType = etherTran.packetTest(hdr);
 
 		switch (pktType)
@@ -299,62 +283,93 @@ static void updateNet(void) //AudioControlEtherTransport::
 				//if(etherTran.printMe) 
 					Serial.println("UN: PING Pkt");
 #endif
-				etherTran.processIncomingPing(udp.remoteIP(), hdr);
-				etherTran.updateSubscriptions();	// fix subscriptions by hostname
+				etherTran.processIncomingPing(etherTran.net->remoteIP(), hdr); // binds any streams waiting for the host name
 				//etherTran.printHosts();
 				break;
 				
 			default : // PKT_NOT_CONSUMED
 #ifdef CE_DEBUG
-				Serial.printf("UN: Unknown pkt: Proto 0x%X\n", hdr.format_SR);	
+				Serial.printf("UN: Unknown pkt: Proto 0x%X\n", hdr->format_SR);	
 #endif
 				break;	
 		}
-		pktSize = udp.parsePacket(); // next waiting UDP packet
 	}
 
+	etherTran.flushReorder();
+
 	// ************* OUTPUT ALL  QUEUED PACKETS  ******************	
 	etherTran.sendPkts(); 
 
-		
-	// regular housekeeping
-	if(millis() - lastHousekeeping < HOUSEKEEPING_EVERY)
-		return;
-	lastHousekeeping = millis();
-	
-	//Serial.println("UN: Update Active Streams");
-	etherTran.updateActiveStreams();
-	etherTran.updateSubscriptions();
-	
-	// send PING for unknown remoteIP addresses - how to avoid pinging one dead host continuously queue? 
-	etherTran.pingUnknownHosts();
-	
-		return; // done housekeeping for now
+	// regular housekeeping - spread over successive calls
+	if(etherTran.hkStep == 0 && millis() - lastHousekeeping >= HOUSEKEEPING_EVERY)
+	{
+		lastHousekeeping = millis();
+		etherTran.hkStep = 1;
+	}
+	if(etherTran.hkStep != 0 && !etherTran.overBudget(0, startUs))
+		etherTran.housekeeping();
 
+	uint32_t took = micros() - startUs;
+	if(took > etherTran.maxNetUs)
+		etherTran.maxNetUs = took;
 } // updateNet
 
+// One housekeeping step per call. hkStep returns to 0 when the cycle is complete
+void AudioControlEtherTransport::housekeeping(void)
+{
+	switch(hkStep)
+	{
+		case 1 :
+			//Serial.println("UN: Update Active Streams");
+			updateActiveStreams();
+			break;
+		case 2 :
+			updateSubscriptions();
+			break;
+		case 3 :
+			// send PING for unknown remoteIP addresses - how to avoid pinging one dead host continuously queue? 
+			pingUnknownHosts();
+			break;
+	}
+	hkStep = (hkStep >= 3) ? 0 : hkStep + 1;
+}
+
+// packet and time limits for one updateNet() call. Zero is unlimited
+void AudioControlEtherTransport::setNetBudget(int pkts, uint32_t us)
+{
+	_budgetPkts = (pkts < 0) ? 0 : pkts;
+	_budgetUs = us;
+}
+
+bool AudioControlEtherTransport::overBudget(int pkts, uint32_t startUs)
+{
+	if(_budgetPkts && pkts >= _budgetPkts)
+		return true;
+	return (_budgetUs && (micros() - startUs) >= _budgetUs);
+}
+
 
 // test for consumable VBAN AUDIO and SERVICE packets (to be queued)
 // register all VBAN hosts
 // all other packets will be not be processed further
-pktType AudioControlEtherTransport::packetTest(vban_header hdr)
+pktType AudioControlEtherTransport::packetTest(const vban_header *hdr)
 {
-	if(hdr.vban != VBAN_FLAG)
+	if(hdr->vban != VBAN_FLAG)
 		return PKT_NOT_CONSUMED;
 	
 	// register all hosts, even if not consuming packets
-	if(getHostIDfromIP(udp.remoteIP()) == EOQ)
-		addHost(udp.remoteIP());
+	hostSeen(net->remoteIP());
 	
-	uint8_t proto = hdr.format_SR & VBAN_PROTOCOL_MASK;
+	uint8_t proto = hdr->format_SR & VBAN_PROTOCOL_MASK;
 	switch (proto)
 	{	
 		case VBAN_AUDIO_SHIFTED :
-			if (hdr.format_SR == OK_VBAN_AUDIO_PROTO  && hdr.format_bit == OK_VBAN_FMT)
+			if (audioFormatOK(hdr))
 				return PKT_AUDIO;
+			return PKT_NOT_CONSUMED;
 
 		case VBAN_SERVICE_SHIFTED : 
-			if (hdr.format_nbc == VBAN_SERVICE_ID)
+			if (hdr->format_nbc == VBAN_SERVICE_ID)
 			{
 #ifdef CE_DEBUG	
 				Serial.println("PT: Ping");
@@ -362,21 +377,21 @@ pktType AudioControlEtherTransport::packetTest(vban_header hdr)
 				return PKT_PING;
 			}
 			else
-				if (hdr.format_nbc == VBAN_SERVICE_CHAT)
+				if (hdr->format_nbc == VBAN_SERVICE_CHAT)
 				{
 #ifdef CE_DEBUG	
-					if(etherTran.printMe) Serial.printf("PT: CHAT len = %i\n", udp.size() - VBAN_HDR_SIZE);
+					if(etherTran.printMe) Serial.printf("PT: CHAT len = %i\n", net->size() - VBAN_HDR_SIZE);
 #endif
 					return PKT_CHAT;
 				}
 #ifdef CE_DEBUG	
-			if(etherTran.printMe) Serial.printf("PT: Service %i\n", hdr.format_nbc);
+			if(etherTran.printMe) Serial.printf("PT: Service %i\n", hdr->format_nbc);
 #endif
 			return PKT_SERVICE;
 			
 			
 			case VBAN_SERIAL_SHIFTED : // not implemented				
-				if(hdr.format_bit == VBAN_MIDI_SHIFTED)
+				if(hdr->format_bit == VBAN_MIDI_SHIFTED)
 				{
 #ifdef CE_DEBUG	
 					Serial.println("PT: MIDI");
@@ -400,57 +415,241 @@ pktType AudioControlEtherTransport::packetTest(vban_header hdr)
 	
 }
 
+// Round-robin transmit scheduler
+// Every active output queue gets up to _txBudget packets per call. The starting stream rotates each call, 
+// so no stream is always served first. Packets still queued at the end of the pass are counted as deferred.
 void AudioControlEtherTransport::sendPkts() // Ethernet/UDP specific volatile int * queue, int actStr
 {
-	//queuePkt *pkt;
-	std::queue <queuePkt> *qp;
-	// loop through subscriptions and empty each queue
-	for(int i = 0; i < MAX_UDP_STREAMS; i++)
+	if(_txBusy.exchange(true, std::memory_order_acquire)) // can't happen from mainline, but be safe
+		return;
+	int first = _txNext;
+	_txNext = (_txNext + 1) % MAX_UDP_STREAMS;
+	
+	for(int n = 0; n < MAX_UDP_STREAMS; n++)
+	{
+		int i = (first + n) % MAX_UDP_STREAMS;
+		if(!streamsOut[i].active || qpOut[i] == nullptr)
+			continue;
+		int budget = _txBudget;
+		while(budget > 0 && sendOne(i))
+			budget--;
+		txDeferred += qpOut[i]->size();
+	}
+	_txBusy.store(false, std::memory_order_release);
+} 
+
+// send the packet at the front of an output queue. false if the queue is empty or the backend refused it
+bool AudioControlEtherTransport::sendOne(int i)
+{
+	pktQueue *qp = qpOut[i];
+	if(qp->size() == 0)
+		return false;
+	queuePkt *qqp = &(qp->front());
+	const uint8_t *pkt = (uint8_t *)&qqp->hdr; // only transmit the VBAN + content portion of the queued packet
+	int len = pktLength(qqp);
+	destList *dl = destOut[i];
+	if(dl == nullptr) // one destination
 	{
-		if(streamsOut[i].active && qpOut[i] != nullptr)
+		if(!net->send(streamsOut[i].remoteIP, VBAN_UDP_PORT, pkt, len))
 		{
-			qp = qpOut[i];
-			if(qp->size() > 0) // just send one packet per cycle
-			{
-				uint8_t *pkt  = (uint8_t *)&(qp->front().hdr.vban); // only transmit the VBAN + content portion of the queued packet
-				queuePkt *qqp = (queuePkt *)&(qp->front());
-
-				// only send correct size packet
-				int len;
-				if(qqp->hdr.format_SR == OK_VBAN_AUDIO_PROTO)
-					len = (qqp->hdr.format_nbs + 1) * (qqp->hdr.format_nbc + 1) * BYTES_SAMPLE + VBAN_HDR_SIZE;
-					//len = sizeof(vbanPkt);
-				else
-				{
-					len = qqp->samplesUsed + VBAN_HDR_SIZE;
-				}
-				
-				if(udp.send(streamsOut[i].remoteIP, VBAN_UDP_PORT, pkt, len))
-				{
-					streamsOut[i].lastPktTime = millis();				
-					qp->pop();		
-				}
-				else
+			txSendFailed++;
 #ifdef CE_DEBUG	
-					if(printMe) Serial.println("^^^^Did not send");
+			if(printMe) Serial.println("^^^^Did not send");
 #endif	
-				return;
+			return false; // stack is out of buffers - leave the packet for next time
+		}
+	}
+	else
+	{
+		// the same packet to each destination. A refused send is resumed from that destination next time
+		for(; dl->next < dl->count; dl->next++)
+		{
+			netDest &d = dl->dest[dl->next];
+			if(!net->send(d.ip, VBAN_UDP_PORT, pkt, len))
+			{
+				d.failed++;
+				txSendFailed++;
+				return false;
 			}
+			d.sent++;
 		}
+		dl->next = 0;
 	}
-} 
+	streamsOut[i].lastPktTime = millis();				
+	qp->pop();
+	return true;
+}
+
+// audio that inputs can play: PCM in any format_net.h can decode or compressed frames (codec_net.h), at any VBAN rate up to MAX_NET_SAMPLE_RATE (converted to the audio library's rate)
+bool AudioControlEtherTransport::audioFormatOK(const vban_header *hdr)
+{
+	int sr = hdr->format_SR & VBAN_SPEEDMASK;
+	if(sr >= VBAN_AUDIO_SR_MAXNUMBER || VBAN_AUDIO_SRList[sr] > MAX_NET_SAMPLE_RATE)
+		return false;
+	return vbanDecoder(hdr->format_bit) != nullptr || hdr->format_bit == NET_FMT_COMPRESSED;
+}
+
+// only send correct size packet
+int AudioControlEtherTransport::pktLength(const queuePkt *qqp)
+{
+	if((qqp->hdr.format_SR & VBAN_PROTOCOL_MASK) == VBAN_AUDIO_SHIFTED && qqp->hdr.format_bit != NET_FMT_COMPRESSED) // compressed: samplesUsed is the payload
+		return (qqp->hdr.format_nbs + 1) * (qqp->hdr.format_nbc + 1) * BYTES_SAMPLE + VBAN_HDR_SIZE;
+	return qqp->samplesUsed + VBAN_HDR_SIZE;
+}
+
+/**************** PACED TRANSMIT ***********************/
+// TX_PACE_YIELD: (default) packets are sent by updateNet(), i.e. whenever user code yields.
+// TX_PACE_AUDIO: each output sends its packets from its own update(), as soon as queueBlocks() has built them.
+// TX_PACE_TIMER: a hardware timer sends one waiting packet (round-robin across streams) every intervalUs.
+// In the paced modes, packets are spaced at least intervalUs apart and updateNet() still sends anything left behind.
+// Paced packets are sent from interrupt context. paceTx() stays out while updateNet() has the network stack, 
+// but QNEthernet's own yield() hook is not protected: disable QNETHERNET_DO_LOOP_IN_YIELD for paced modes 
+// (updateNet() polls the stack itself).
+#if defined(TEENSYDUINO)
+static IntervalTimer paceTimer;
+static void paceTimerISR(void)
+{
+	etherTran.paceTx(EOQ);
+}
+#endif
+
+bool AudioControlEtherTransport::setTxPacing(txPaceMode mode, uint32_t intervalUs)
+{
+#if defined(TEENSYDUINO)
+	paceTimer.end();
+#endif
+	_txPaceUs = intervalUs;
+	txPaceMode use = mode;
+	if(mode == TX_PACE_TIMER)
+	{
+#if defined(TEENSYDUINO)
+		if(intervalUs == 0 || !paceTimer.begin(paceTimerISR, intervalUs))
+			use = TX_PACE_YIELD;
+#else
+		use = TX_PACE_YIELD; // no hardware timer on this platform
+#endif
+	}
+	_txPace = use;
+	return (use == mode); // false: fell back to TX_PACE_YIELD
+}
+
+void AudioControlEtherTransport::txReady(int stream)
+{
+	if(_txPace == TX_PACE_AUDIO)
+		paceTx(stream);
+}
+
+void AudioControlEtherTransport::paceTx(int stream)
+{
+	if(!etherTranBegun || netBusy || _txBusy.exchange(true, std::memory_order_acquire))
+	{
+		txPaceSkipped++;
+		return;
+	}
+	bool tick = (stream == EOQ);
+	if(tick) // timer tick: next stream with something to send
+	{
+		for(int n = 0; n < MAX_UDP_STREAMS; n++)
+		{
+			int i = (_txNext + n) % MAX_UDP_STREAMS;
+			if(streamsOut[i].active && qpOut[i] != nullptr && qpOut[i]->size() > 0)
+			{
+				stream = i;
+				_txNext = (i + 1) % MAX_UDP_STREAMS;
+				break;
+			}
+		}
+	}
+	if(stream >= 0 && stream < MAX_UDP_STREAMS && streamsOut[stream].active && qpOut[stream] != nullptr)
+	{
+		int budget = (tick) ? 1 : _txBudget;
+		while(budget > 0 && (micros() - _lastPacedTx) >= _txPaceUs && sendOne(stream))
+		{
+			_lastPacedTx = micros();
+			txPaced++;
+			budget--;
+		}
+	}
+	_txBusy.store(false, std::memory_order_release);
+}
 
+void AudioControlEtherTransport::setTxBudget(int pkts)
+{
+	_txBudget = (pkts < 1) ? 1 : pkts;
+}
+
+// destination lists are changed from mainline code. Holding _txBusy keeps paceTx() (interrupt) out while they are
+bool AudioControlEtherTransport::addDestination(destList *dl, IPAddress ip)
+{
+	for(int j = 0; j < dl->count; j++)
+		if(dl->dest[j].ip == ip)
+			return true;
+	if(dl->count >= MAX_DESTINATIONS)
+		return false;
+	bool was = _txBusy.exchange(true, std::memory_order_acquire);
+	dl->dest[dl->count] = netDest();
+	dl->dest[dl->count].ip = ip;
+	dl->count++;
+	_txBusy.store(was, std::memory_order_release);
+	return true;
+}
+
+// the last destination stays
+bool AudioControlEtherTransport::removeDestination(destList *dl, IPAddress ip)
+{
+	for(int j = 0; j < dl->count && dl->count > 1; j++)
+	{
+		if(dl->dest[j].ip == ip)
+		{
+			bool was = _txBusy.exchange(true, std::memory_order_acquire);
+			for(int k = j; k < dl->count - 1; k++)
+				dl->dest[k] = dl->dest[k + 1];
+			dl->count--;
+			if(dl->next > j) // part sent: the rest of the list moved down
+				dl->next--;
+			_txBusy.store(was, std::memory_order_release);
+			return true;
+		}
+	}
+	return false;
+}
+
+// hostsIn lookup: linear probe from the IP hash
 int AudioControlEtherTransport::getHostIDfromIP(IPAddress ip)
 {
-	for(int i = 0; i < MAX_REM_HOSTS; i++)
-		if(streamsIn[i].remoteIP == ip)
-			return i;	
+	uint32_t key = (uint32_t)ip;
+	for(int n = 0, i = ipHash(ip) & (HOST_INDEX_SIZE - 1); n < HOST_INDEX_SIZE; n++, i = (i + 1) & (HOST_INDEX_SIZE - 1))
+	{
+		int h = _hostIndex[i];
+		if(h == EOQ)
+			return EOQ;
+		if(hostsIn[h].active && (uint32_t)hostsIn[h].remoteIP == key)
+			return h;
+	}
 	return EOQ;
 }
 
+// one lookup per packet. Unknown hosts are added
+int AudioControlEtherTransport::hostSeen(IPAddress ip)
+{
+	int id = getHostIDfromIP(ip);
+	if(id == EOQ)
+		id = addHost(ip);
+	if(id != EOQ)
+		hostsIn[id].lastSeen = millis();
+	return id;
+}
+
+IPAddress AudioControlEtherTransport::getHostIPfromID(int id)
+{
+	if (id < 0 || id >= MAX_REM_HOSTS || !hostsIn[id].active)
+		return IPAddress((uint32_t)0);
+	return hostsIn[id].remoteIP;
+}
+
 const char* AudioControlEtherTransport::getHostNamefromID(int id)
 {
-	if (id >= MAX_REM_HOSTS || !hostsIn[id].active)
+	if (id < 0 || id >= MAX_REM_HOSTS || !hostsIn[id].active)
 		return "*";
 	return hostsIn[id].hostName;
 }
@@ -458,38 +657,95 @@ const char* AudioControlEtherTransport::getHostNamefromID(int id)
 IPAddress AudioControlEtherTransport::getHostIPfromName(char * hostName)
 {
 	for(int i = 0; i < MAX_REM_HOSTS; i++)
-		if(strncmp(hostsIn[i].hostName, hostName, VBAN_HOSTNAME_LEN))
+		if(hostsIn[i].active && strncmp(hostsIn[i].hostName, hostName, VBAN_HOSTNAME_LEN) == 0)
 			return hostsIn[i].remoteIP;	
 	return IPAddress((uint32_t)0);
 }
 
 // add new host IP
+// When the table is full, the host that has been silent longest is replaced
 int AudioControlEtherTransport::addHost(IPAddress remoteIP)
 {
+	int id = getHostIDfromIP(remoteIP);
+	if(id != EOQ)
+		return id;
+
 	int empty = EOQ;
+	int oldest = EOQ;
+	uint32_t now = millis();
 	for(int i = 0; i < MAX_REM_HOSTS; i++)
 	{
-		if(hostsIn[i].remoteIP == remoteIP)
-			return i;
-		if(empty == EOQ && !hostsIn[i].active)
+		if(!hostsIn[i].active)
+		{
 			empty = i;
+			break;
+		}
+		if(oldest == EOQ || (now - hostsIn[i].lastSeen) > (now - hostsIn[oldest].lastSeen))
+			oldest = i;
+	}
+	if(empty == EOQ)
+	{
+		if(oldest == EOQ)
+			return EOQ;
+		evictHost(oldest);
+		empty = oldest;
 	}
-	if(empty == EOQ) // no free slots
-		return EOQ;
 		
 	hostsIn[empty].remoteIP = remoteIP;
 	hostsIn[empty].active = true;
+	hostsIn[empty].lastSeen = now;
+	hostsIn[empty].lastPinged = 0;
 	strcpy(hostsIn[empty].hostName, "*");
+	indexHost(empty);
 	return empty;
 }
 
+// drop a host and any stream references to it
+void AudioControlEtherTransport::evictHost(int id)
+{
+#ifdef CE_DEBUG
+	Serial.printf("-- Evicting host %i '%s'\n", id, hostsIn[id].hostName);
+#endif
+	hostsIn[id].active = false;
+	for(int i = 0; i < MAX_UDP_STREAMS; i++)
+	{
+		if(streamsIn[i].hostIndx == id)
+			streamsIn[i].hostIndx = EOQ;
+		if(streamsOut[i].hostIndx == id)
+			streamsOut[i].hostIndx = EOQ;
+	}
+	hostsEvicted++;
+	rebuildHostIndex();
+}
+
+void AudioControlEtherTransport::indexHost(int id)
+{
+	for(int n = 0, i = ipHash(hostsIn[id].remoteIP) & (HOST_INDEX_SIZE - 1); n < HOST_INDEX_SIZE; n++, i = (i + 1) & (HOST_INDEX_SIZE - 1))
+	{
+		if(_hostIndex[i] == EOQ || _hostIndex[i] == id)
+		{
+			_hostIndex[i] = id;
+			break;
+		}
+	}
+}
+
+void AudioControlEtherTransport::rebuildHostIndex(void)
+{
+	for(int i = 0; i < HOST_INDEX_SIZE; i++)
+		_hostIndex[i] = EOQ;
+	for(int i = 0; i < MAX_REM_HOSTS; i++)
+		if(hostsIn[i].active)
+			indexHost(i);
+}
+
 // Incoming PING packet hostname to IP address update
 // If it's a PING request, reply.
-int AudioControlEtherTransport::processIncomingPing(IPAddress remoteIP, vban_header vbh)
+int AudioControlEtherTransport::processIncomingPing(IPAddress remoteIP, const vban_header *vbh)
 {
-	const uint8_t *dptr = udp.data() + VBAN_HDR_SIZE;
-	vban_ping vbp;
-	memcpy((void*)&vbp, (void*)dptr, sizeof(vban_ping));
+	if(net->size() < (int)(VBAN_HDR_SIZE + sizeof(vban_ping))) // runt
+		return EOQ;
+	const vban_ping &vbp = *(const vban_ping *)(net->data() + VBAN_HDR_SIZE);
 	
 	int i = addHost(remoteIP); // will just return index if already there
 	if(i == EOQ)
@@ -501,11 +757,14 @@ int AudioControlEtherTransport::processIncomingPing(IPAddress remoteIP, vban_hea
 	Serial.printf("-- Colour 0x%04x\n", vbp.color_rgb);
 #endif
 	strncpy(hostsIn[i].hostName, vbp.HostName_ascii, VBAN_HOSTNAME_LEN);
-	hostsIn[i].remoteIP = remoteIP;
-	updateHostStreams(i);
+	// same name at another, now quiet, address: the host has re-addressed
+	for(int h = 0; h < MAX_REM_HOSTS; h++)
+		if(h != i && hostsIn[h].active && hostQuiet(h) && strncmp(hostsIn[h].hostName, hostsIn[i].hostName, VBAN_HOSTNAME_LEN) == 0)
+			hostMoved(h);
+	bindHost(i);
 	
 	// if this is a ping request, reply	 ********* Add nuFrame ***********
-	if(!vbh.format_nbs) 
+	if(!vbh->format_nbs) 
 		sendPing(remoteIP, false);
 	
 	return i;
@@ -514,11 +773,12 @@ int AudioControlEtherTransport::processIncomingPing(IPAddress remoteIP, vban_hea
 // ping the first unmatched host that exceeds the timestamped limit
 // only ping hosts with multiple active streams once
 // LAST_PING_GAP == HOUSEKEEPING_EVERY * MAX_REM_HOSTS
+// hosts that have gone quiet are not pinged - they will be pinged again if they reappear
 void AudioControlEtherTransport::pingUnknownHosts()
 {
 	//Serial.printf("PingUnknown: ");
 	for(int i = 0; i < MAX_REM_HOSTS; i++)
-		if(hostsIn[i].active && hostsIn[i].hostName[0] == '*' ) 
+		if(hostsIn[i].active && hostsIn[i].hostName[0] == '*' && (millis() - hostsIn[i].lastSeen) < HOST_STALE_TIME) 
 		{
 			hostsIn[i].lastPinged = millis();
 			//Serial.printf("Pinging %i '%s' ", i, hostsIn[i].hostName);
@@ -553,7 +813,10 @@ void AudioControlEtherTransport::sendPing(IPAddress remoteIP, bool request)
 	if(!(uint32_t)remoteIP)
 		remoteIP = getMyBroadcastIP();
 
-	udp.send(remoteIP, VBAN_UDP_PORT, pkt, pktSize);
+	{
+		netBusyGuard busy; // may be called from user code (announce())
+		net->send(remoteIP, VBAN_UDP_PORT, pkt, pktSize);
+	}
 	
 	//Serial.printf("Sent ping [%i, len %i] = %i to ", _pings, pktSize, res);
 	//Serial.println(remoteIP);
@@ -565,6 +828,112 @@ IPAddress AudioControlEtherTransport::getMyBroadcastIP(void)
 	return _myBroadcastIP;
 }
 
+/**** multicast groups ****/
+// Subscriptions may be made before begin(): the group is recorded and joined by etherStart()
+bool AudioControlEtherTransport::joinGroup(IPAddress group)
+{
+	if(!isMulticastIP(group))
+		return false;
+	int slot = EOQ;
+	for(int i = 0; i < MAX_GROUPS; i++)
+	{
+		if(_groups[i].refs && _groups[i].ip == group)
+		{
+			_groups[i].refs++;
+			return true;
+		}
+		if(!_groups[i].refs && slot == EOQ)
+			slot = i;
+	}
+	if(slot == EOQ)
+		return false;
+	bool joined = false;
+	if(net != nullptr && net->linkState())
+	{
+		netBusyGuard busy;
+		joined = net->joinGroup(group);
+		if(!joined) // e.g. a backend without multicast
+			return false;
+	}
+	_groups[slot].ip = group;
+	_groups[slot].refs = 1;
+	_groups[slot].joined = joined;
+#ifdef CE_DEBUG
+	Serial.print("CE: join group ");
+	Serial.println(group);
+#endif
+	return true;
+}
+
+void AudioControlEtherTransport::leaveGroup(IPAddress group)
+{
+	for(int i = 0; i < MAX_GROUPS; i++)
+	{
+		if(_groups[i].refs && _groups[i].ip == group)
+		{
+			if(--_groups[i].refs == 0 && _groups[i].joined)
+			{
+				netBusyGuard busy;
+				net->leaveGroup(group);
+				_groups[i].joined = false;
+			}
+			return;
+		}
+	}
+}
+
+// a group the backend refuses takes its subscriptions down with it, rather than leaving them open to any sender
+void AudioControlEtherTransport::joinGroups(void)
+{
+	for(int i = 0; i < MAX_GROUPS; i++)
+	{
+		if(!_groups[i].refs || _groups[i].joined)
+			continue;
+		_groups[i].joined = net->joinGroup(_groups[i].ip);
+		if(_groups[i].joined)
+			continue;
+		Serial.print("Failed to join multicast group ");
+		Serial.println(_groups[i].ip);
+		for(int j = 0; j < MAX_SUBSCRIPTIONS; j++)
+			if(subsIn[j].group == _groups[i].ip)
+				subsIn[j].active = false;
+	}
+}
+
+int AudioControlEtherTransport::groupsJoined(void)
+{
+	int count = 0;
+	for(int i = 0; i < MAX_GROUPS; i++)
+		if(_groups[i].joined)
+			count++;
+	return count;
+}
+
+// 239.255.86.x: administratively scoped (site local). Names that share a group only cost some unwanted packets
+IPAddress AudioControlEtherTransport::getGroupIP(const char *streamName)
+{
+	uint8_t h = 0;
+	for(int i = 0; i < VBAN_STREAM_NAME_LENGTH && streamName[i]; i++)
+		h = h * 31 + (uint8_t)streamName[i];
+	return IPAddress(239, 255, 86, h);
+}
+
+// false: the group couldn't be joined (table full, or no multicast)
+bool AudioControlEtherTransport::setSubAddress(int sub, IPAddress remoteIP)
+{
+	subsIn[sub].group = IPAddress((uint32_t)0);
+	if(!isMulticastIP(remoteIP))
+	{
+		subsIn[sub].ipAddress = remoteIP;
+		return true;
+	}
+	if(!joinGroup(remoteIP))
+		return false;
+	subsIn[sub].ipAddress = IPAddress((uint32_t)0);
+	subsIn[sub].group = remoteIP;
+	return true;
+}
+
 
 void AudioControlEtherTransport::setStreamName_O(char * sName, int stream)
 {	// can only set the stream name output objects) access this via a function in output object
@@ -574,12 +943,10 @@ void AudioControlEtherTransport::setStreamName_O(char * sName, int stream)
 
 int AudioControlEtherTransport::getStreamFromSub(int sub)
 {
-	if(sub == EOQ)
+	if(sub < 0 || sub >= MAX_SUBSCRIPTIONS)
 		return EOQ;
-	for(int i = 0; i < MAX_UDP_STREAMS; i++)
-		if(streamsIn[i].active && streamsIn[i].subscription == sub)
-			return i;
-	return EOQ;
+	int s = subsIn[sub].streamID;
+	return (s != EOQ && streamsIn[s].active) ? s : EOQ;
 }
 
 void AudioControlEtherTransport::setColour(uint32_t colour)
@@ -24,8 +24,12 @@
 #include "Audio.h"
 #include "audio_net.h"
 #include "audio_vban.h"
+#include "format_net.h"
+#include "codec_net.h"
 #include "control_ethernet.h"
+#include "ce_backend.h"
 #include "IPAddress.h"
+#include <atomic>
 
 //#define CE_DEBUG
 
@@ -35,6 +39,17 @@
 #define HOUSEKEEPING_EVERY	5000			// 500 in PROD. resolve new streams and hosts
 #define DHCP_TIMEOUT 				15000			// 15 secs
 #define QN_PKT_QUEUE				12				// QNE queue length for incoming packets
+#define STREAM_INDEX_SIZE		hashTableSize(MAX_UDP_STREAMS)	// streamsIn hash index
+#define HOST_INDEX_SIZE			hashTableSize(MAX_REM_HOSTS)		// hostsIn hash index
+#define HOST_STALE_TIME			30000			// don't ping hosts that have been silent this long (mS)
+#define STREAM_HIT_CACHE		8					// last stream seen, per source IP hash. Power of 2
+#define NET_BUDGET_PKTS			0					// default most packets processed per updateNet() call (0: no limit)
+#define NET_BUDGET_US				0					// default most uS spent processing packets per updateNet() call (0: no limit)
+#define TX_BUDGET_PER_STREAM	4				// most packets sent from one output queue per updateNet() call
+#define MAX_GROUPS					MAX_SUBSCRIPTIONS	// multicast groups joined at once
+
+// when output packets are sent - see setTxPacing()
+enum txPaceMode {TX_PACE_YIELD, TX_PACE_AUDIO, TX_PACE_TIMER};
 
 /*************** Ethernet connections, sockets and UDP datagrams **************/
 class AudioControlEtherTransport 
@@ -45,8 +60,8 @@ public:
 	friend class AudioControlEthernet;
 	/*
 	// do not need these - AudioControlEthernet bridges between these classes and this one
-	friend class AudioOutputNet; // work with others sharing this control
-	friend class AudioInputNet;		// may not need these - AudioControlEthernet bridges between
+	friend class AudioOutputNetBase; // work with others sharing this control
+	friend class AudioInputNetBase;		// may not need these - AudioControlEthernet bridges between
 	friend class AudioOutputServiceNet;
   friend class AudioInputServiceNet;
 */
@@ -56,6 +71,8 @@ public:
 	// The functions and variables below are not for end user access. 
 	// They are kept public for access from lambda code udpdateNet()
 	bool etherStart(void); // in begin() or after cable diconnection 
+	void setBackend(EtherBackend *backend); // before begin(). Defaults to QNEthernet (Teensy) or POSIX sockets (host builds)
+	EtherBackend *net = nullptr; // all datagram I/O goes through here
 
 	//static void updateNet(void); // ersatz update() called as lambda type function attached to EventResponder
 	// *** Anything called or used by lambda updateNet() needs to be public ***
@@ -64,6 +81,13 @@ public:
 	bool linkIsUp(void);
 	IPAddress getMyBroadcastIP(void);
 	bool etherTranBegun = false;
+
+	// multicast: groups are refcounted, the backend joins on first use and leaves after the last
+	bool joinGroup(IPAddress group);
+	void leaveGroup(IPAddress group);
+	IPAddress getGroupIP(const char *streamName);	// a group for the stream name, so senders and receivers agree without configuration
+	int groupsJoined(void);
+	bool setSubAddress(int sub, IPAddress remoteIP);	// unicast: the sender. Multicast: join the group, any sender. false: couldn't join
 	
 private: // not accessed by updateNet() or functions called from there
 	void updateIP(void);
@@ -71,20 +95,35 @@ private: // not accessed by updateNet() or functions called from there
 	IPAddress _myBroadcastIP = {0,0,0,255};
 	uint8_t _myMAC[6]; // set by LWIP
 	uint16_t _udpPort; 
+	void joinGroups(void);	// groups subscribed before the link was up
+	struct
+	{
+		IPAddress ip;
+		uint8_t refs = 0;
+		bool joined = false;	// the backend has joined
+	} _groups[MAX_GROUPS];
 
 	// registered hosts
 public:
 	int getHostIDfromIP(IPAddress ip); 	//return remoteHost ID from IP address 
+	int hostSeen(IPAddress ip);		// per packet: find or add the host, mark it as seen
 	IPAddress getHostIPfromID(int id);
 	const char *getHostNamefromID(int id);
 	IPAddress getHostIPfromName(char * hostName);
 	const char *getHostNameFromIP(IPAddress ip);
 	
 	// VBAN PING
-	int processIncomingPing(IPAddress remoteIP, vban_header vbh); // process incoming PING response
+	int processIncomingPing(IPAddress remoteIP, const vban_header *vbh); // process incoming PING response
 	void pingUnknownHosts(); // Ping all unknkown hosts in sequence
 	void sendPing(IPAddress remoteIP, bool request = true);
-	int addHost(IPAddress remoteIP);
+	uint32_t hostsEvicted = 0;	// hosts replaced because hostsIn was full
+private:
+	void evictHost(int id);
+	void indexHost(int id);
+	void rebuildHostIndex(void);
+	int16_t _hostIndex[HOST_INDEX_SIZE];	// hostsIn slots, open addressed by IP hash. EOQ: empty
+public:
+	int addHost(IPAddress remoteIP);	// index of the (new or existing) host
 	void setColour(uint32_t colour); // ***BGR*** Voicemeeter chat: 24-bit background colour	
 	uint32_t _colour = 0x0000C0; // Voicemeeter chat background 24-bit **BGR** (RED)	
 private:
@@ -101,20 +140,39 @@ public:
 
 public:
 // ***** Audio streams, hosts and subscriptions ***********
-	pktType packetTest(vban_header hdr); // incoming packet triage
+	pktType packetTest(const vban_header *hdr); // incoming packet triage
+	bool audioFormatOK(const vban_header *hdr);	// rate and sample format can be played
 	
 	hostInfo			hostsIn[MAX_REM_HOSTS];
 	subscription 	subsIn[MAX_SUBSCRIPTIONS];
 	streamInfo		streamsIn[MAX_UDP_STREAMS];	
 	streamInfo	streamsOut[MAX_UDP_STREAMS]; 				// output streams don't need hosts or subs, just a queue
-	std::queue <queuePkt> *qpOut[MAX_UDP_STREAMS]; // Set by output::subscribe(). Queues are owned by outputs.
+	pktQueue *qpOut[MAX_UDP_STREAMS]; // Set by output::subscribe(). Queues are owned by outputs.
+	destList *destOut[MAX_UDP_STREAMS];	// audio outputs' destinations, also owned by outputs. nullptr: streamsOut[].remoteIP only
+	pktPool rxPool;		// buffers for queued incoming packets (see pkt_pool.h)
 	int VBpktsProc;
 	int udpDroppedPkts;
 
+// ********* updateNet() work budget *********
+public:
+	void setNetBudget(int pkts, uint32_t us);	// limits for one updateNet() call (0: no limit)
+	bool overBudget(int pkts, uint32_t startUs);
+	void housekeeping(void);		// one step of the housekeeping cycle
+	int hkStep = 0;							// next housekeeping step. 0: idle
+	uint32_t budgetHits = 0;		// updateNet() calls that left packets for the next call
+	uint32_t maxNetUs = 0;			// longest updateNet() call
+private:
+	int _budgetPkts = NET_BUDGET_PKTS;
+	uint32_t _budgetUs = NET_BUDGET_US;
+
 // ********* stream and host registration and  management *********
 public:
-	void updateHostStreams(int hostID);
-	void updateStreamSubscription(int streamID);
+	bool subMatches(int sub, int stream);	// the subscription accepts this stream
+	bool bindStream(int stream);					// event: new stream
+	bool bindSubscription(int sub);				// event: subscribe()
+	void unbindSubscription(int sub);			// event: unSubscribe()
+	void bindHost(int hostID);						// event: host name known (PING)
+	void hostMoved(int oldHost);					// event: host name seen at a new IP
 	void setStreamName_O(char * sName, int stream);	// private - user levelversion is in the output object
 	int getRegisterStreamId(const uint8_t * pkt, IPAddress remoteIP,pktType type = PKT_AUDIO);
 	void registerStreamInPkt(const uint8_t * pkt, IPAddress remoteIP, int slot, bool isNew, pktType type = PKT_AUDIO);
@@ -122,14 +180,58 @@ public:
 	void updateActiveStreams();
 	void updateSubscriptions(void); // 
 	void updateStreamInfo(int StreamID, streamInfo spkt);
+	int findStreamIn(const streamKey &key);	// streamsIn slot or EOQ
+	void rebuildStreamIndex(void);		// after a streamsIn slot is cleared or reused
+	uint32_t streamHits = 0;					// lookups answered by the last-hit cache
 private:	
 	int activeUDPstreams_I; // counts of registered incoming and outgoing audio streams
+	void linkSubStream(int sub, int stream);
+	bool subIsFree(int sub);
+	uint32_t rebindTime(int stream);
+	bool hostQuiet(int hostID);
+	void indexStreamIn(int slot);
+	int16_t _streamIndex[STREAM_INDEX_SIZE];	// streamsIn slots, open addressed by key hash. EOQ: empty
+	struct
+	{
+		uint32_t ip = 0;
+		int16_t slot = EOQ;
+	} _streamHit[STREAM_HIT_CACHE];
+	int _streamsInUsed = 0;
 
 // ********  queues ************
 public:
   int queuePacket(pktType type = PKT_AUDIO); // called by lambda updateNet()
   bool addPacketToQueue(int inStream, pktType type);	
+	void setReorderWindow(int sub, int frames);	// 0 .. REORDER_MAX frames
+	void flushReorder(void);				// release held packets to inputs that have run dry
 	void sendPkts(); 
+	int pktLength(const queuePkt *qqp);	// VBAN header + content bytes
+	void setTxBudget(int pkts);		// per stream, per updateNet() call
+	bool addDestination(destList *dl, IPAddress ip);			// safe against paced transmit
+	bool removeDestination(destList *dl, IPAddress ip);
+	uint32_t txDeferred = 0;		// packets left queued after a sendPkts() pass
+	uint32_t txSendFailed = 0;	// backend refused a packet
+
+	// paced transmit: packets leave from the audio update (or a hardware timer) rather than from yield()
+	bool setTxPacing(txPaceMode mode, uint32_t intervalUs = 0);
+	void txReady(int stream);		// called by output objects after queueing a packet
+	void paceTx(int stream);		// send now. stream == EOQ: next waiting packet, round-robin
+	uint32_t txPaced = 0;				// packets sent by paceTx()
+	uint32_t txPaceSkipped = 0;	// paceTx() calls that left packets for updateNet()
+	volatile bool netBusy = false;	// mainline code is using the network stack - paceTx() must not
+private:
+	int _txBudget = TX_BUDGET_PER_STREAM;
+	int _txNext = 0;	// stream sendPkts() starts with - rotates every call
+	txPaceMode _txPace = TX_PACE_YIELD;
+	uint32_t _txPaceUs = 0;		// minimum gap between paced packets
+	uint32_t _lastPacedTx = 0;
+	std::atomic<bool> _txBusy {false}; // an output queue consumer is running. Only one may run at a time
+	bool sendOne(int stream);
+	bool reorderPkt(int sub, queuePkt *pkt);
+	void releaseHeld(int sub, bool skipGaps);
+	bool deliverPkt(int sub, queuePkt *pkt);
+	void resetReorder(int sub);
+public:
 
 #ifdef CTRL_ETHERNET_DO_LOOP_IN_YIELD
 	void attachLoopToYield(AudioControlEtherTransport * me);
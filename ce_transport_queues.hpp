@@ -1,9 +1,8 @@
 /*
  * Ethernet (UDP) Network Control object for Teensy Audio Library
  * Handles all Network-side queue management
- * All audio queue manipulation must be with **interrupts off**
- *
- * Interrupts need to be off whenever queue management functions are called from updateNet()
+ * updateNet() is the only producer for input queues and the only consumer for output queues,
+ * so queue management here needs no interrupt masking (see spsc_queue.h)
  *
  * Sept 2024 Richard Palmer
  * Released under GNU Affero General Public License v3.0 or later
@@ -20,7 +19,10 @@ bool AudioControlEtherTransport::initQueues()
 { 
 	if (_initializedQ) 	return true;
 	for(int i = 0; i < MAX_UDP_STREAMS; i++)
-		qpOut[i] = (std::queue <queuePkt> *)nullptr;
+	{
+		qpOut[i] = (pktQueue *)nullptr;
+		destOut[i] = nullptr;
+	}
 	_initializedQ = true;
 	//Serial.println("Queues initialized");
 	return true;
@@ -34,19 +36,11 @@ bool AudioControlEtherTransport::initQueues()
 int AudioControlEtherTransport::queuePacket(pktType type) 
 {
 
-	//int pktSize = udp.size();
-	const uint8_t *UDPdata = udp.data();
+	const uint8_t *UDPdata = net->data(); // header is read in place, not copied
 	
-	vban_header hdr;	
-	memcpy((void*)&hdr, (void*)UDPdata, sizeof(vban_header));
-	/*
-	uint8_t pktProto, pktFmt;
-	pktProto = hdr.format_SR;
-	pktFmt = hdr.format_bit;
-*/
-	int streamID = etherTran.getRegisterStreamId(UDPdata, udp.remoteIP(), type); // register all consumable VBAN streams
+	int streamID = etherTran.getRegisterStreamId(UDPdata, net->remoteIP(), type); // register all consumable VBAN streams
 #ifdef CE_DEBUG
-	//if(type != PKT_AUDIO) Serial.printf("qp: Queue non-audio packet type %i, stream %i, active %i, subs %i, siz %i\n", type, streamID, etherTran.streamsIn[streamID].active, etherTran.streamsIn[streamID].subscription, udp.size() - VBAN_HDR_SIZE);
+	//if(type != PKT_AUDIO) Serial.printf("qp: Queue non-audio packet type %i, stream %i, active %i, subs %i, siz %i\n", type, streamID, etherTran.streamsIn[streamID].active, etherTran.streamsIn[streamID].subscription, net->size() - VBAN_HDR_SIZE);
 #endif
 	if (streamID < 0) // something went wrong with the registration or it's an output stream
 		return 0; 			// dump the packet
@@ -78,7 +72,8 @@ int AudioControlEtherTransport::queuePacket(pktType type)
 
 // queue packet  
 // Only SUBSCRIBED streams are queued
-// For now, only AUDIO (44.1kHz, PCM16), SERVICE (not PING) packets are queued
+// For now, only AUDIO (see audioFormatOK()), SERVICE (not PING) packets are queued
+// The datagram is copied once, into a receive pool slot. Only the slot pointer is queued.
 
 bool AudioControlEtherTransport::addPacketToQueue(int inStream, pktType type)
 {
@@ -86,15 +81,12 @@ bool AudioControlEtherTransport::addPacketToQueue(int inStream, pktType type)
 	qpkts++;
 	//bool etherTran.printMe = (pkts % 500 == 200) && millis() > 4000;
 	
-	queuePkt qPkt;
-	const uint8_t *packet = udp.data();
-
-	vban_header *header = (vban_header *)packet;
-	const unsigned char *data = packet;
+	const uint8_t *packet = net->data();
+	const vban_header *header = (const vban_header *)packet;
 	
 	streamsIn[inStream].lastPktTime = millis();  // register packet time, even if we can't queue it
 	
-	std::queue <queuePkt> *qPtr = etherTran.subsIn[etherTran.streamsIn[inStream].subscription].qPtr;
+	pktHandleQueue *qPtr = etherTran.subsIn[etherTran.streamsIn[inStream].subscription].qPtr;
 #ifdef CE_DEBUG
 	int sub = streamsIn[inStream].subscription;
 #endif
@@ -111,11 +103,9 @@ bool AudioControlEtherTransport::addPacketToQueue(int inStream, pktType type)
 	}
 
 	static int dumped = 0;
-	cli();
-		int siz = qPtr->size(); // near enough. Update() may consume 1 or 2 packets before the push() below
-	sei();
+	int siz = qPtr->size(); // near enough. Update() may consume 1 or 2 packets before the push() below
 	//Serial.printf("**** AddPkt2Q UDP packet, stream %i, type %i, Qlen %i, dumped %i, qptr %X\n", inStream, type, qPtr->size(), dumped, qPtr);
-	if(siz >= MAX_AUDIO_QUEUE) // dump the packet
+	if(siz >= MAX_AUDIO_QUEUE || (type == PKT_AUDIO && siz * (header->format_nbs + 1) >= AUDIO_QUEUE_SAMPLES)) // dump the packet
 	{
 		dumped++;
 		if(etherTran.printMe) {
@@ -130,33 +120,57 @@ bool AudioControlEtherTransport::addPacketToQueue(int inStream, pktType type)
 	uint32_t streamLastFrame = etherTran.streamsIn[inStream].hdr.nuFrame;
 	int channels, samples, dataSize;
 	
-	qPkt.streamIndx = inStream;
+	int usedBytes; // content size for service packets
 	
 	if(type == PKT_AUDIO)
 	{
 		channels = header->format_nbc + 1;
 		samples  = header->format_nbs + 1;
-		dataSize = VBAN_HDR_SIZE + samples * channels * BYTES_SAMPLE; 
-		qPkt.samplesUsed = 0; // for input object.
+		if(header->format_bit == NET_FMT_COMPRESSED) // variable length. Only for subscriptions that asked for it
+		{
+			if(!subsIn[streamsIn[inStream].subscription].compressed || net->size() < VBAN_HDR_SIZE + NET_CODEC_HDR)
+				return 0;
+			dataSize = net->size();
+			usedBytes = dataSize - VBAN_HDR_SIZE; // payload for netDecode()
+		}
+		else
+		{
+			dataSize = VBAN_HDR_SIZE + samples * channels * vbanDecoder(header->format_bit)->bytes; // format checked by packetTest()
+			usedBytes = 0; // for input object.
+		}
 	}
 	else
 	{
 		channels = 1;
-		samples  = udp.size(); // header + data
+		samples  = net->size(); // header + data
 		dataSize = samples; 
-		qPkt.samplesUsed = samples - VBAN_HDR_SIZE; // just the content size in bytes
+		usedBytes = samples - VBAN_HDR_SIZE; // just the content size in bytes
 #ifdef CE_DEBUG
 		//Serial.printf("APQ non A: stream %i, sub %i, type %i, pkt len %i, ptr 0x%04X\n", inStream, sub, type, dataSize, qPtr);
 #endif
 	}
+	if(dataSize > net->size() || dataSize > (int)(VBAN_HDR_SIZE + VBAN_MAX_DATA)) // truncated or oversize datagram
+		return 0;
 
-	memcpy((void*)&qPkt.hdr, (void*)data, dataSize); // byte by byte copy
-	//Serial.printf("APQ Queued packet stream %i, fc '%c'\n", inStream, qPkt.c.content[0]);
+	queuePkt *qPkt = rxPool.alloc();
+	if(qPkt == nullptr) // all receive buffers are in use
+		return 0;
+	qPkt->streamIndx = inStream;
+	qPkt->samplesUsed = usedBytes;
+	memcpy((void*)&qPkt->hdr, (void*)packet, dataSize); // the only copy of the datagram
 	//if(etherTran.printMe)Serial.printf("APQ Queued packet stream %i, chans %i, samples %i\n", inStream, channels, samples);
 	
-	cli();
-		qPtr->push(qPkt); // queue it
-	sei();
+	bool queued;
+	if(type == PKT_AUDIO) // service packets don't carry a frame sequence
+		queued = reorderPkt(streamsIn[inStream].subscription, qPkt);
+	else
+	{
+		queued = qPtr->push(qPkt); // queue it
+		if(!queued)
+			rxPool.release(qPkt);
+	}
+	if(!queued)
+		return 0;
 	
 	if(type != PKT_AUDIO && 0) 
 #ifdef CE_DEBUG
@@ -164,18 +178,168 @@ bool AudioControlEtherTransport::addPacketToQueue(int inStream, pktType type)
 #endif
 	
 	dumped = 0;
+
+	// jitter: deviation of the arrival gap from the packet's duration, smoothed over 16 packets
+	uint32_t now = micros();
+	int sr = header->format_SR & VBAN_SPEEDMASK;
+	if(type == PKT_AUDIO && header->nuFrame == (streamLastFrame + 1) && streamsIn[inStream].arrivalUs != 0 && sr < VBAN_AUDIO_SR_MAXNUMBER)
+	{
+		int32_t d = (int32_t)(now - streamsIn[inStream].arrivalUs) - (int32_t)((uint64_t)samples * 1000000 / VBAN_AUDIO_SRList[sr]);
+		if(d < 0)
+			d = -d;
+		streamsIn[inStream].jitterUs += (d - (int32_t)streamsIn[inStream].jitterUs) / 16;
+	}
+	streamsIn[inStream].arrivalUs = now;
+
+	// clock drift: samples sent against our time since the measurement started. Arrival jitter matters less as the span grows
+	if(type == PKT_AUDIO && sr < VBAN_AUDIO_SR_MAXNUMBER)
+	{
+		streamInfo &st = streamsIn[inStream];
+		uint32_t span = now - st.rateUs;
+		int32_t frames = (int32_t)(header->nuFrame - st.rateFrame);
+		double ppm = 0;
+		if(span >= DRIFT_SPAN_MIN)
+			ppm = ((double)frames * samples * 1000000 / span / VBAN_AUDIO_SRList[sr] - 1.0) * 1000000;
+		if(st.rateUs == 0 || frames < 0 || span > DRIFT_SPAN_MAX || ppm > DRIFT_MAX_PPM || ppm < -DRIFT_MAX_PPM) // (re)start: the last estimate stands meanwhile
+		{
+			st.rateUs = now;
+			st.rateFrame = header->nuFrame;
+		}
+		else if(span >= DRIFT_SPAN_MIN)
+			st.driftPpm = (int32_t)ppm;
+	}
 		
-	if(qPkt.hdr.nuFrame != (streamLastFrame + 1)) // dropped packet
+	int32_t ahead = (int32_t)(header->nuFrame - streamLastFrame);
+	if(ahead <= 0) // late - the reorder window has dealt with it
+		return true;
+	if(ahead > 1) // dropped (or not yet arrived) packet
 	{
-		qPktsDropped += qPkt.hdr.nuFrame - streamLastFrame;
+		qPktsDropped += ahead - 1;
 #ifdef CE_DEBUG
-		if(etherTran.printMe) Serial.printf("***** AddPkt2Q dropped frame, tot %i [%i - %i], udp q len %i\n", qPktsDropped, streamLastFrame, qPkt.hdr.nuFrame, qPtr->size() );
+		if(etherTran.printMe) Serial.printf("***** AddPkt2Q dropped frame, tot %i [%i - %i], udp q len %i\n", qPktsDropped, streamLastFrame, header->nuFrame, qPtr->size() );
 #endif
 	}
-	etherTran.streamsIn[inStream].hdr.nuFrame = qPkt.hdr.nuFrame; // also done  in getRegisterStreamId --> getRegisterStreamId
+	etherTran.streamsIn[inStream].frameUs = now;
+	etherTran.streamsIn[inStream].hdr.nuFrame = header->nuFrame; // registerStreamInPkt() leaves nuFrame alone for known streams
+	return true;
+}
+
+// ****** reorder window ******
+// Audio packets reach the subscription's queue in nuFrame order. A packet that arrives ahead of a missing frame is held
+// for up to reorderWindow frames. If the missing frame turns up it is queued and the held packets follow it; otherwise
+// the gap is passed on (the input conceals it) and a straggler arriving later is dropped.
+// Producer side only: called from updateNet() and, for release, from user code that doesn't run inside it.
+
+bool AudioControlEtherTransport::reorderPkt(int sub, queuePkt *pkt)
+{
+	subscription &s = subsIn[sub];
+	uint32_t frame = pkt->hdr.nuFrame;
+	int32_t ahead = (int32_t)(frame - s.nextFrame);
+	if(s.reorderWindow == 0 || !s.seqValid || ahead > REORDER_MAX * 4 || ahead < -REORDER_MAX * 4) // off, first packet, or the sender has restarted
+	{
+		releaseHeld(sub, true);
+		s.seqValid = true;
+		s.nextFrame = frame + 1;
+		return deliverPkt(sub, pkt);
+	}
+	if(ahead < 0) // its slot has been given up (or a duplicate)
+	{
+		s.tooLate++;
+		rxPool.release(pkt);
+		return false;
+	}
+	if(ahead == 0)
+	{
+		if(s.heldCount > 0)
+			s.reordered++;
+		s.nextFrame++;
+		bool ok = deliverPkt(sub, pkt);
+		releaseHeld(sub, false);
+		return ok;
+	}
+	int slot = frame % REORDER_MAX;
+	if(ahead <= s.reorderWindow)
+	{
+		if(s.held[slot] != nullptr) // duplicate
+		{
+			rxPool.release(pkt);
+			return false;
+		}
+		s.held[slot] = pkt;
+		s.heldCount++;
+		return true;
+	}
+	// too far ahead: stop waiting for the missing frames
+	releaseHeld(sub, true);
+	s.nextFrame = frame + 1;
+	return deliverPkt(sub, pkt);
+}
+
+// queue held packets that are now in sequence. skipGaps: give up on missing frames
+void AudioControlEtherTransport::releaseHeld(int sub, bool skipGaps)
+{
+	subscription &s = subsIn[sub];
+	while(s.heldCount > 0)
+	{
+		int slot = s.nextFrame % REORDER_MAX;
+		queuePkt *pkt = s.held[slot];
+		if(pkt != nullptr && pkt->hdr.nuFrame == s.nextFrame)
+		{
+			s.held[slot] = nullptr;
+			s.heldCount--;
+			deliverPkt(sub, pkt);
+		}
+		else if(!skipGaps)
+			break;
+		s.nextFrame++;
+	}
+}
+
+bool AudioControlEtherTransport::deliverPkt(int sub, queuePkt *pkt)
+{
+	pktHandleQueue *qPtr = subsIn[sub].qPtr;
+	if(qPtr == nullptr || !qPtr->push(pkt))
+	{
+		rxPool.release(pkt);
+		return false;
+	}
 	return true;
 }
 
+// drop held packets without queueing them (unsubscribe, or the subscription moves to another stream)
+void AudioControlEtherTransport::resetReorder(int sub)
+{
+	subscription &s = subsIn[sub];
+	for(int i = 0; i < REORDER_MAX; i++)
+	{
+		if(s.held[i] != nullptr)
+			rxPool.release(s.held[i]);
+		s.held[i] = nullptr;
+	}
+	s.heldCount = 0;
+	s.seqValid = false;
+}
+
+// an input that has run dry can't wait any longer for missing frames
+void AudioControlEtherTransport::flushReorder(void)
+{
+	for(int i = 0; i < MAX_SUBSCRIPTIONS; i++)
+		if(subsIn[i].heldCount > 0 && subsIn[i].qPtr != nullptr && subsIn[i].qPtr->size() == 0)
+			releaseHeld(i, true);
+}
+
+void AudioControlEtherTransport::setReorderWindow(int sub, int frames)
+{
+	if(sub < 0 || sub >= MAX_SUBSCRIPTIONS)
+		return;
+	if(frames < 0)
+		frames = 0;
+	if(frames > REORDER_MAX)
+		frames = REORDER_MAX;
+	releaseHeld(sub, true);
+	subsIn[sub].reorderWindow = frames;
+}
+
 
 // incoming packet to streamsIn matching 
 // streamName and IPAddress is definitive - hostname may not (yet) be known
@@ -183,20 +347,13 @@ int AudioControlEtherTransport::getRegisterStreamId(const uint8_t * packet, IPAd
 {
 	//IPAddress remoteIP = remote;
 	// search through the registered sreamInfo array for matching hdr.streamname and RemoteIP
-	int freeSlot = EOQ;
-	int inactiveSlot = EOQ;
-	//void *pdata = packet;
-	vban_header hdr;
-	
-	//bool etherTran.printMe = /*Serial && */(qpkts % 1000 == 23) && millis() > 5000; // debug	
-
-	memcpy((void*)&hdr, (void *)packet, sizeof(vban_header));
+	const vban_header &hdr = *(const vban_header *)packet; // in place
 	
-	// only register consumable (44.1, PCM, INT16, AUDIO) and SERVICE (not ID) streams
+	// only register consumable (see audioFormatOK()) AUDIO and SERVICE (not ID) streams
 	//uint8_t proto = hdr.format_SR & VBAN_PROTOCOL_MASK;
 
 	if(type == PKT_AUDIO)
-		if (hdr.format_SR == OK_VBAN_AUDIO_PROTO  && hdr.format_bit != OK_VBAN_FMT)
+		if (!audioFormatOK(&hdr))
 		{
 #ifdef CE_DEBUG
 			if(printMe) Serial.printf("******* gRS bad audio\n");
@@ -221,55 +378,32 @@ int AudioControlEtherTransport::getRegisterStreamId(const uint8_t * packet, IPAd
 		return EOQ;
 	}
 
-	for(int i = 0; i < MAX_UDP_STREAMS; i++)
-	{		
-		if(etherTran.streamsIn[i].active)
-		{  // existing stream
-			if(strcmp(hdr.streamname, etherTran.streamsIn[i].hdr.streamname) == 0 && remoteIP == etherTran.streamsIn[i].remoteIP)
-			{
-				//if(etherTran.printMe) Serial.printf("SR: Found stream %i\n", i);
-				// header info may change dynamically (i.e. channels or sampleRate)
-				etherTran.registerStreamInPkt(packet, remoteIP, freeSlot, false, type);
-				//streamsIn[i].lastPktTime = millis();
-				//register
-				return i; // found
-			}
-		}
-		else // inactive
-		{
-			if(freeSlot == EOQ) 
-			{
-#ifdef CE_DEBUG
-				if(printMe) Serial.printf("SR: New %i\n", i);
-#endif
-					freeSlot = i; // find an empty slot
-			}
-			else
-					if(etherTran.streamsIn[i].lastPktTime < (millis() - DEAD_STREAM_TIME) && inactiveSlot == EOQ) // an input stream with no recent packets
-					{
-#ifdef CE_DEBUG
-						if(printMe) Serial.printf("SR: Inactive %i\n", i);
-#endif
-						inactiveSlot = i;
-					}
-		}
-	}
-
-	// new stream into a free slot or overwrite an inactive stream
-	if (freeSlot >= 0)
+	streamKey key;
+	key.set(remoteIP, hdr.streamname);
+	int i = findStreamIn(key);
+	if(i != EOQ)
 	{
-		//fill stuff in - copy header to .hdr
-		// test for "processablility" and set rest of streams[freeSlot]
-		etherTran.registerStreamInPkt(packet, remoteIP, freeSlot, true, type);
-		return freeSlot;
+		// header info may change dynamically (i.e. channels or sampleRate)
+		etherTran.registerStreamInPkt(packet, remoteIP, i, false, type);
+		return i; // found
 	}
 
-	if (inactiveSlot >= 0)
+	// new stream into a free slot
+	if(_streamsInUsed >= MAX_UDP_STREAMS)
+		return EOQ;
+	for(i = 0; i < MAX_UDP_STREAMS; i++)
 	{
-		//fill stuff in - copy header to .hdr
-		// test for "processablility" and set rest of streams[inactiveSlot]
-		etherTran.registerStreamInPkt(packet, remoteIP, inactiveSlot, true, type); 
-		return inactiveSlot;
+		if(!etherTran.streamsIn[i].active)
+		{
+#ifdef CE_DEBUG
+			if(printMe) Serial.printf("SR: New %i\n", i);
+#endif
+			streamsIn[i].key = key;
+			etherTran.registerStreamInPkt(packet, remoteIP, i, true, type);
+			indexStreamIn(i);
+			bindStream(i); // subscriptions go live on the first packet
+			return i;
+		}
 	}
 	
 	return EOQ;		// no space left, can't find or register new
@@ -278,153 +412,291 @@ int AudioControlEtherTransport::getRegisterStreamId(const uint8_t * packet, IPAd
 
 // name and channels are not stored in the header for input streams
 // header info may change dynamically
-// **** isNew processing is not yet implemented - may not be required as done in main line???
+// Known streams only refresh the format bytes - name and IP already match, nuFrame is tracked by addPacketToQueue()
 void AudioControlEtherTransport::registerStreamInPkt(const uint8_t * pdata, IPAddress remoteIP, int slot, bool isNew, pktType type)
 {
-	if(slot >= MAX_UDP_STREAMS)
+	if(slot < 0 || slot >= MAX_UDP_STREAMS)
 		return;
 
-	memcpy((void *)&streamsIn[slot].hdr, (void *)pdata, sizeof(vban_header));
+	const vban_header *hdr = (const vban_header *)pdata;
+	if(isNew)
+	{
+		if(!streamsIn[slot].active)
+			_streamsInUsed++;
+		memcpy((void *)&streamsIn[slot].hdr, (void *)pdata, sizeof(vban_header));
+		streamsIn[slot].hdr.nuFrame = hdr->nuFrame - 1; // first packet is not a drop
+		streamsIn[slot].arrivalUs = streamsIn[slot].frameUs = streamsIn[slot].jitterUs = 0;
+		streamsIn[slot].rateUs = 0;
+		streamsIn[slot].driftPpm = 0;
+	}
+	else
+	{
+		streamsIn[slot].hdr.format_SR = hdr->format_SR;
+		streamsIn[slot].hdr.format_nbs = hdr->format_nbs;
+		streamsIn[slot].hdr.format_nbc = hdr->format_nbc;
+		streamsIn[slot].hdr.format_bit = hdr->format_bit;
+	}
 	streamsIn[slot].remoteIP = remoteIP;
 	streamsIn[slot].lastPktTime = millis();
 	streamsIn[slot].type = type;
 	streamsIn[slot].active = true;
 }
 
-void	AudioControlEtherTransport::updateActiveStreams()
+// streamsIn lookup by (remoteIP, name)
+// Sources usually send one stream, so the last stream seen from the same IP is tried first.
+// Otherwise linear probe from the key hash - cost does not depend on the number of streams.
+int AudioControlEtherTransport::findStreamIn(const streamKey &key)
 {
-	int count = 0;
-	//Serial.println("Update Active streams");
+	int h = ipHash(key.ip) & (STREAM_HIT_CACHE - 1);
+	int s = _streamHit[h].slot;
+	if(s != EOQ && _streamHit[h].ip == key.ip && streamsIn[s].active && streamsIn[s].key == key)
+	{
+		streamHits++;
+		return s;
+	}
+	for(int n = 0, i = key.hash & (STREAM_INDEX_SIZE - 1); n < STREAM_INDEX_SIZE; n++, i = (i + 1) & (STREAM_INDEX_SIZE - 1))
+	{
+		s = _streamIndex[i];
+		if(s == EOQ)
+			return EOQ;
+		if(streamsIn[s].active && streamsIn[s].key == key)
+		{
+			_streamHit[h].ip = key.ip;
+			_streamHit[h].slot = s;
+			return s;
+		}
+	}
+	return EOQ;
+}
+
+void AudioControlEtherTransport::indexStreamIn(int slot)
+{
+	for(int n = 0, i = streamsIn[slot].key.hash & (STREAM_INDEX_SIZE - 1); n < STREAM_INDEX_SIZE; n++, i = (i + 1) & (STREAM_INDEX_SIZE - 1))
+	{
+		if(_streamIndex[i] == EOQ || _streamIndex[i] == slot)
+		{
+			_streamIndex[i] = slot;
+			break;
+		}
+	}
+}
+
+// open addressing has no cheap delete, so the index is rebuilt from the active streams
+void AudioControlEtherTransport::rebuildStreamIndex(void)
+{
+	for(int i = 0; i < STREAM_INDEX_SIZE; i++)
+		_streamIndex[i] = EOQ;
+	for(int i = 0; i < STREAM_HIT_CACHE; i++)
+		_streamHit[i].slot = EOQ;
+	_streamsInUsed = 0;
 	for(int i = 0; i < MAX_UDP_STREAMS; i++)
 	{
 		if(streamsIn[i].active)
 		{
-			count++;
-			if(streamsIn[i].subscription == EOQ)
-				updateStreamSubscription(i);	
+			indexStreamIn(i);
+			_streamsInUsed++;
 		}
 	}
-	activeUDPstreams_I = count;
 }
 
+/**** subscription matching ***/
+// Event driven: each event only touches the entries it affects
+//	new stream					bindStream()
+//	subscribe()					bindSubscription()
+//	unSubscribe()				unbindSubscription()
+//	PING (host name)		bindHost()
+// Housekeeping (updateActiveStreams(), updateSubscriptions()) is only a backstop.
+
+// the one matching rule
+// Protocol bits must match, and the sample rate if the subscription specifies one.
+// Then the IP address if given, otherwise the host name if given, otherwise any host.
+bool AudioControlEtherTransport::subMatches(int sub, int stream)
+{
+	const subscription &s = subsIn[sub];
+	const streamInfo &st = streamsIn[stream];
+	if(!s.active || s.qPtr == nullptr || !st.active)
+		return false;
+	uint8_t proto = (uint8_t)s.protocol;
+	if((st.hdr.format_SR & VBAN_PROTOCOL_MASK) != (proto & VBAN_PROTOCOL_MASK))
+		return false;
+	if((proto & ~VBAN_PROTOCOL_MASK) && st.hdr.format_SR != proto)
+		return false;
+	if(strncmp(s.streamName, st.hdr.streamname, VBAN_STREAM_NAME_LENGTH) != 0)
+		return false;
+	if(s.ipAddress != IPAddress((uint32_t)0))
+		return st.remoteIP == s.ipAddress;
+	if(s.hostName[0] != '?' && s.hostName[0] != '\0')
+		return st.hostIndx != EOQ && strncmp(s.hostName, hostsIn[st.hostIndx].hostName, VBAN_HOSTNAME_LEN) == 0;
+	return true; // promiscuous
+}
 
-// update references from hostsIn to streamsIn/streamsOut 
-// activate / update waiting subscriptions
-void AudioControlEtherTransport::updateHostStreams(int hostID)
-{ 
-	int i, j;
-	//Serial.printf("Updating hostStream subscriptions: host %i\n", hostID);
-	IPAddress remoteIP = hostsIn[hostID].remoteIP;
+void AudioControlEtherTransport::linkSubStream(int sub, int stream)
+{
+	int old = subsIn[sub].streamID;
+	if(old != EOQ && old != stream && streamsIn[old].subscription == sub)
+		streamsIn[old].subscription = EOQ;
+	streamsIn[stream].subscription = sub;
+	if(subsIn[sub].streamID != stream)
+		resetReorder(sub); // frame numbers belong to the old stream
+	subsIn[sub].streamID = stream;
+#ifdef CE_DEBUG
+	Serial.printf("~~~~ bound sub %i '%s' to streamIn %i\n", sub, subsIn[sub].streamName, stream);
+#endif
+}
 
-	// StreamsIn
-	for(j = 0; j < MAX_SUBSCRIPTIONS; j++) // find matching subscriptions, update streams->hosts
+// a subscription's stream may be replaced once it has gone quiet (e.g. the sender has re-addressed)
+bool AudioControlEtherTransport::subIsFree(int sub)
+{
+	int s = subsIn[sub].streamID;
+	return s == EOQ || !streamsIn[s].active || (millis() - streamsIn[s].lastPktTime) > rebindTime(s);
+}
+
+// quiet time (mS) before a stream's subscription may move: several of its own frames, so slow rates and large frames aren't cut off
+uint32_t AudioControlEtherTransport::rebindTime(int stream)
+{
+	const vban_header &h = streamsIn[stream].hdr;
+	int sr = h.format_SR & VBAN_SPEEDMASK;
+	if(streamsIn[stream].type != PKT_AUDIO || sr >= VBAN_AUDIO_SR_MAXNUMBER)
+		return STREAM_REBIND_MIN;
+	uint32_t t = (uint32_t)STREAM_REBIND_FRAMES * (h.format_nbs + 1) * 1000 / VBAN_AUDIO_SRList[sr];
+	return (t > STREAM_REBIND_MIN) ? t : STREAM_REBIND_MIN;
+}
+
+// no packets from this host for the rebind time of its slowest stream
+bool AudioControlEtherTransport::hostQuiet(int hostID)
+{
+	uint32_t quiet = STREAM_REBIND_MIN;
+	for(int i = 0; i < MAX_UDP_STREAMS; i++)
+		if(streamsIn[i].active && streamsIn[i].remoteIP == hostsIn[hostID].remoteIP && rebindTime(i) > quiet)
+			quiet = rebindTime(i);
+	return (millis() - hostsIn[hostID].lastSeen) > quiet;
+}
+
+// new (or newly named) stream: bind it to the first waiting subscription
+bool AudioControlEtherTransport::bindStream(int stream)
+{
+	streamInfo &st = streamsIn[stream];
+	if(!st.active)
+		return false;
+	st.hostIndx = getHostIDfromIP(st.remoteIP);
+	if(st.subscription != EOQ)
+		return true;
+	for(int j = 0; j < MAX_SUBSCRIPTIONS; j++)
 	{
-		// match streamName and IP for active streams. Update subscription if both active and streams
-		if(1)
+		if(subMatches(j, stream) && subIsFree(j))
 		{
-		//	Serial.printf("~~~~Testing subs %i: streams: " , j);
-			for(i = 0; i < MAX_UDP_STREAMS; i++)
-			{
-				if(streamsIn[i].active)
-				{
-					//Serial.printf("%i: '%s' '%s', " , i, subsIn[j].streamName, streamsIn[i].hdr.streamname);
-					if ((streamsIn[i].remoteIP == remoteIP))		// 
-					{
-						streamsIn[i].hostIndx = hostID;
-						if(subsIn[j].active && strncmp(subsIn[j].streamName, streamsIn[i].hdr.streamname, VBAN_STREAM_NAME_LENGTH) == 0 && subsIn[j].protocol == (streamsIn[i].hdr.format_SR & VBAN_PROTOCOL_MASK))
-							streamsIn[i].subscription = j;
-					 //Serial.printf("~~~~~~found streamIn %i, '%s', host'%s'\n", i, subsIn[j].streamName, hostsIn[hostID].hostName);
-					}
-				}
-			}
+			linkSubStream(j, stream);
+			return true;
 		}
 	}
-	//Serial.println();
-	
-	//streamsOut 
-	for(i = 0; i < MAX_UDP_STREAMS; i++)
+	// host name not yet known: ask now rather than waiting for housekeeping
+	if(st.hostIndx != EOQ && hostsIn[st.hostIndx].hostName[0] == '*' && hostsIn[st.hostIndx].lastPinged == 0)
 	{
-		if(streamsOut[i].active)
-		{				
-			if (streamsOut[i].remoteIP == remoteIP)
-			{
-				streamsOut[i].hostIndx = hostID;
-			  //Serial.printf("~~~~~~found streamOut %i, host'%s'\n", i, hostsIn[hostID].hostName);
-			}
+		hostsIn[st.hostIndx].lastPinged = millis();
+		sendPing(st.remoteIP);
+	}
+	return false;
+}
+
+// new subscription: bind it to the first matching unbound stream
+bool AudioControlEtherTransport::bindSubscription(int sub)
+{
+	if(sub < 0 || sub >= MAX_SUBSCRIPTIONS)
+		return false;
+	if(subsIn[sub].streamID != EOQ && !subIsFree(sub))
+		return true;
+	for(int i = 0; i < MAX_UDP_STREAMS; i++)
+	{
+		if(streamsIn[i].subscription == EOQ && subMatches(sub, i))
+		{
+			linkSubStream(sub, i);
+			return true;
 		}
 	}
+	return false;
 }
-// activate subscriptions from new stream to known host
-// activate waiting subscriptions
-void AudioControlEtherTransport::updateStreamSubscription(int streamID)
-{ 
-	int i, j;
-	//Serial.printf("~~~~ Updating new StreamIn %i to host / subscription\n", streamID);
 
-	if(!streamsIn[streamID].active)
+// packets stop being queued immediately. The released stream may be wanted by another subscription.
+void AudioControlEtherTransport::unbindSubscription(int sub)
+{
+	if(sub < 0 || sub >= MAX_SUBSCRIPTIONS)
 		return;
- 
-	// match subscription host name to stream hostname, where inStream remoteIP = hostIP
-	for(j = 0; j < MAX_SUBSCRIPTIONS; j++) // find matching subscriptions, update streams->hosts
+	int s = subsIn[sub].streamID;
+	subsIn[sub].active = false;
+	subsIn[sub].streamID = EOQ;
+	if(s != EOQ && streamsIn[s].subscription == sub)
+		streamsIn[s].subscription = EOQ;
+	resetReorder(sub);
+	subsIn[sub].reordered = subsIn[sub].tooLate = 0;
+	subsIn[sub].compressed = false;
+	subsIn[sub].qPtr = nullptr;
+	if(subsIn[sub].group != IPAddress((uint32_t)0))
 	{
-		// match streamName, IP and protocol for active streams. Update subscription if  active		
-		//Serial.printf("~~~~Testing hosts %i: streams: " , j);
-		for(i = 0; i < MAX_REM_HOSTS; i++)
+		leaveGroup(subsIn[sub].group);
+		subsIn[sub].group = IPAddress((uint32_t)0);
+	}
+	if(s != EOQ)
+		bindStream(s);
+}
+
+// host name is now known (PING): update its streams and bind any that were waiting for the name
+void AudioControlEtherTransport::bindHost(int hostID)
+{
+	IPAddress remoteIP = hostsIn[hostID].remoteIP;
+	for(int i = 0; i < MAX_UDP_STREAMS; i++)
+	{
+		if(streamsIn[i].active && streamsIn[i].remoteIP == remoteIP)
 		{
-			if(hostsIn[i].active && subsIn[j].active)
-			{
-				//Serial.printf("j:i %i:%i '%s' =?= '%s';   " , j, i, subsIn[j].hostName, hostsIn[i].hostName);
-				if(strcmp(subsIn[j].hostName, hostsIn[i].hostName) == 0 && subsIn[j].protocol == (streamsIn[streamID].hdr.format_SR & VBAN_PROTOCOL_MASK))
-				{
-					streamsIn[streamID].subscription = j;	
-					subsIn[j].streamID = streamID;
-#ifdef CE_DEBUG
-					Serial.printf("~~~~ updateStrSub: found streamIn %i: sub %i '%s', host %i '%s', proto 0x%2X\n", streamID, j, subsIn[j].hostName, i, hostsIn[i].hostName, subsIn[j].protocol);
-#endif
-				}
-			}
+			streamsIn[i].hostIndx = hostID;
+			if(streamsIn[i].subscription == EOQ)
+				bindStream(i);
+		}
+		if(streamsOut[i].active && streamsOut[i].remoteIP == remoteIP)
+			streamsOut[i].hostIndx = hostID;
+	}
+}
+
+// The same host name has turned up at a new address.
+// Release streams from the old address that were bound by that host name, so bindHost() can move them to the new one.
+// Subscriptions to any host ("?") or to a fixed IP stay put.
+void AudioControlEtherTransport::hostMoved(int oldHost)
+{
+	IPAddress oldIP = hostsIn[oldHost].remoteIP;
+	for(int i = 0; i < MAX_UDP_STREAMS; i++)
+	{
+		int sub = streamsIn[i].subscription;
+		if(streamsIn[i].active && streamsIn[i].remoteIP == oldIP && sub != EOQ && subsIn[sub].ipAddress == IPAddress((uint32_t)0)
+			&& subsIn[sub].hostName[0] != '?' && strncmp(subsIn[sub].hostName, hostsIn[oldHost].hostName, VBAN_HOSTNAME_LEN) == 0)
+		{
+			streamsIn[i].subscription = EOQ;
+			subsIn[sub].streamID = EOQ;
 		}
 	}
 }
 
 /**** housekeeping ***/
 
-// Ensure all active subscriptions are mapped to active streams and vice versa
-// ******Could also age streams 
-void AudioControlEtherTransport::updateSubscriptions(void)
+void	AudioControlEtherTransport::updateActiveStreams()
 {
-	//Serial.print("~~~~~~ updSubs: ");
-	int i, j;
-	for(j = 0 ; j < MAX_UDP_STREAMS; j++)
-	{
-		//if(streamsIn[j].subscription != EOQ) // already subscribed
-		//		break;
-		//streamsIn[j].subscription = EOQ;
-		for (i = 0; i < MAX_SUBSCRIPTIONS; i++)
+	int count = 0;
+	for(int i = 0; i < MAX_UDP_STREAMS; i++)
+	{
+		if(streamsIn[i].active)
 		{
-			// stream names and protocols must match
-			if(streamsIn[j].active && subsIn[i].active && (strcmp(streamsIn[j].hdr.streamname, subsIn[i].streamName) == 0) && (streamsIn[j].hdr.format_SR == subsIn[i].protocol))
-			{
-				// plus: IP address match or hostname match or IP address == any {0.0.0.0}
-				if(streamsIn[j].remoteIP == subsIn[i].ipAddress || streamsIn[j].remoteIP == getHostIPfromName(subsIn[i].hostName) || subsIn[i].ipAddress == IPAddress((uint32_t)0))
-				{
-					streamsIn[j].subscription = i;
-					subsIn[i].streamID = j;
-					//Serial.printf("~~~~~~ updSubs: matched sub %i with stream %i", i, j);
-					break;
-				}
-				// Or: promiscuous mode - no IP or hostname in subscription
-				if(subsIn[j].ipAddress == IPAddress((uint32_t)0) && subsIn[i].hostName[0] == '?')
-				{
-					streamsIn[j].subscription = i;
-					subsIn[i].streamID = j;
-					//Serial.printf("~~~~~~ updSubs: promiscuous matched sub %i with stream %i", i, j);
-					break;
-				}
-			}
+			count++;
+			if(streamsIn[i].subscription == EOQ)
+				bindStream(i);
 		}
 	}
-	//Serial.println();
+	activeUDPstreams_I = count;
+}
+
+// backstop: waiting subscriptions, or those whose stream has gone quiet
+void AudioControlEtherTransport::updateSubscriptions(void)
+{
+	for(int j = 0; j < MAX_SUBSCRIPTIONS; j++)
+		if(subsIn[j].active && subIsFree(j))
+			bindSubscription(j);
 }
 
 const char * AudioControlEtherTransport::getHostNameFromIP(IPAddress ip)
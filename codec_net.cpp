@@ -0,0 +1,330 @@
+/* Compressed audio frames for Teensy to Teensy links
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <string.h>
+#include "codec_net.h"
+
+#define RICE_ESC		20		// this many 1s: an 18 bit residual follows as is
+#define RICE_RAW_BITS	18	// zigzag residuals of 16 bit audio are below 2^18
+#define RICE_MAX_K	17
+
+static const int16_t silence[NET_FRAME_MAX] = {0};
+
+/******** IMA ADPCM ********/
+static const int8_t adpcmIndexTab[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+static const int16_t adpcmStepTab[89] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// apply a code to the state: encoder and decoder both use this, so they can't drift apart
+static inline int16_t adpcmStep(adpcmState &s, uint8_t code)
+{
+	int step = adpcmStepTab[s.index];
+	int diff = step >> 3;
+	if(code & 4)
+		diff += step;
+	if(code & 2)
+		diff += step >> 1;
+	if(code & 1)
+		diff += step >> 2;
+	int32_t p = s.pred + ((code & 8) ? -diff : diff);
+	s.pred = (p > 32767) ? 32767 : (p < -32768) ? -32768 : (int16_t)p;
+	int idx = s.index + adpcmIndexTab[code];
+	s.index = (idx < 0) ? 0 : (idx > 88) ? 88 : idx;
+	return s.pred;
+}
+
+static inline uint8_t adpcmCode(adpcmState &s, int16_t x)
+{
+	int step = adpcmStepTab[s.index];
+	int diff = x - s.pred;
+	uint8_t code = 0;
+	if(diff < 0)
+	{
+		code = 8;
+		diff = -diff;
+	}
+	if(diff >= step)
+	{
+		code |= 4;
+		diff -= step;
+	}
+	if(diff >= (step >> 1))
+	{
+		code |= 2;
+		diff -= step >> 1;
+	}
+	if(diff >= (step >> 2))
+		code |= 1;
+	adpcmStep(s, code);
+	return code;
+}
+
+static int encodeAdpcm(const int16_t * const *src, int channels, int n, adpcmState *state, uint8_t *dst)
+{
+	uint8_t *p = dst;
+	for(int c = 0; c < channels; c++)
+	{
+		p[0] = (uint8_t)state[c].pred;
+		p[1] = (uint8_t)(state[c].pred >> 8);
+		p[2] = state[c].index;
+		p[3] = 0;
+		p += NET_ADPCM_CH_HDR;
+	}
+	for(int c = 0; c < channels; c++)
+	{
+		adpcmState &s = state[c];
+		const int16_t *x = (src[c] == nullptr) ? silence : src[c];
+		for(int j = 0; j < n; j += 2)
+		{
+			uint8_t lo = adpcmCode(s, x[j]);
+			uint8_t hi = (j + 1 < n) ? adpcmCode(s, x[j + 1]) : 0;
+			*p++ = lo | (hi << 4);
+		}
+	}
+	return p - dst;
+}
+
+static bool decodeAdpcm(const uint8_t *src, int bytes, int channels, int n, int16_t * const *dst, int dstChannels)
+{
+	int codeBytes = (n + 1) / 2;
+	if(channels * (NET_ADPCM_CH_HDR + codeBytes) > bytes)
+		return false;
+	const uint8_t *codes = src + channels * NET_ADPCM_CH_HDR;
+	for(int c = 0; c < channels && c < dstChannels; c++)
+	{
+		const uint8_t *h = src + c * NET_ADPCM_CH_HDR;
+		adpcmState s;
+		s.pred = (int16_t)(h[0] | (h[1] << 8));
+		s.index = (h[2] > 88) ? 88 : h[2];
+		const uint8_t *p = codes + c * codeBytes;
+		int16_t *d = dst[c];
+		for(int j = 0; j < n; j += 2, p++)
+		{
+			d[j] = adpcmStep(s, *p & 0x0F);
+			if(j + 1 < n)
+				d[j + 1] = adpcmStep(s, *p >> 4);
+		}
+	}
+	return true;
+}
+
+/******** lossless: second order prediction, Rice coding ********/
+struct bitWriter
+{
+	uint8_t *p;
+	uint32_t acc = 0;
+	int bits = 0;
+};
+
+static inline void putBits(bitWriter &w, uint32_t v, int len) // len <= 24
+{
+	w.acc = (w.acc << len) | (v & ((1u << len) - 1));
+	w.bits += len;
+	while(w.bits >= 8)
+	{
+		w.bits -= 8;
+		*w.p++ = (uint8_t)(w.acc >> w.bits);
+	}
+}
+
+struct bitReader
+{
+	const uint8_t *p;
+	const uint8_t *end;
+	uint32_t acc = 0;
+	int bits = 0;
+	bool under = false;	// read past the end
+};
+
+static inline uint32_t getBits(bitReader &r, int len) // len <= 24
+{
+	while(r.bits < len)
+	{
+		uint8_t b = 0;
+		if(r.p < r.end)
+			b = *r.p++;
+		else
+			r.under = true;
+		r.acc = (r.acc << 8) | b;
+		r.bits += 8;
+	}
+	r.bits -= len;
+	return (r.acc >> r.bits) & ((1u << len) - 1);
+}
+
+static inline int riceBits(uint32_t u, int k)
+{
+	uint32_t q = u >> k;
+	return (q < RICE_ESC) ? q + 1 + k : RICE_ESC + RICE_RAW_BITS;
+}
+
+static int encodeLossless(const int16_t * const *src, int channels, int n, uint8_t *dst)
+{
+	uint8_t *p = dst;
+	uint32_t u[NET_FRAME_MAX];
+	for(int c = 0; c < channels; c++)
+	{
+		const int16_t *x = (src[c] == nullptr) ? silence : src[c];
+		int32_t x1 = 0, x2 = 0;
+		uint32_t sum = 0;
+		for(int j = 0; j < n; j++)
+		{
+			int32_t s = x[j];
+			int32_t r = s - (2 * x1 - x2);
+			u[j] = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);	// zigzag
+			sum += u[j];
+			x2 = x1;
+			x1 = s;
+		}
+		int k = 0;
+		while(k < RICE_MAX_K && ((uint32_t)n << (k + 1)) < sum) // 2^k near the mean
+			k++;
+		int bits = 0;
+		for(int j = 0; j < n; j++)
+			bits += riceBits(u[j], k);
+		int len = (bits + 7) / 8;
+		uint8_t *h = p;
+		p += NET_LOSSLESS_CH_HDR;
+		if(len >= n * 2) // noise: PCM is smaller
+		{
+			h[0] = NET_RICE_RAW;
+			len = n * 2;
+			for(int j = 0; j < n; j++)
+			{
+				*p++ = (uint8_t)x[j];
+				*p++ = (uint8_t)(x[j] >> 8);
+			}
+		}
+		else
+		{
+			h[0] = k;
+			bitWriter w;
+			w.p = p;
+			for(int j = 0; j < n; j++)
+			{
+				uint32_t q = u[j] >> k;
+				if(q < RICE_ESC)
+				{
+					for(; q > 16; q -= 16)
+						putBits(w, 0xFFFF, 16);
+					putBits(w, ((1u << q) - 1) << 1, q + 1);	// q 1s, then 0
+					if(k > 0)
+						putBits(w, u[j], k);
+				}
+				else
+				{
+					putBits(w, (1u << RICE_ESC) - 1, RICE_ESC);
+					putBits(w, u[j], RICE_RAW_BITS);
+				}
+			}
+			if(w.bits > 0)
+				*w.p++ = (uint8_t)(w.acc << (8 - w.bits));
+			p = w.p;
+		}
+		h[1] = (uint8_t)len;
+		h[2] = (uint8_t)(len >> 8);
+	}
+	return p - dst;
+}
+
+static bool decodeLossless(const uint8_t *src, int bytes, int channels, int n, int16_t * const *dst, int dstChannels)
+{
+	const uint8_t *p = src, *end = src + bytes;
+	for(int c = 0; c < channels && c < dstChannels; c++) // channels are sequential: stop after the last one wanted
+	{
+		if(p + NET_LOSSLESS_CH_HDR > end)
+			return false;
+		uint8_t k = p[0];
+		int len = p[1] | (p[2] << 8);
+		p += NET_LOSSLESS_CH_HDR;
+		if(p + len > end)
+			return false;
+		int16_t *d = dst[c];
+		if(k == NET_RICE_RAW)
+		{
+			if(len != n * 2)
+				return false;
+			for(int j = 0; j < n; j++)
+				d[j] = (int16_t)(p[2 * j] | (p[2 * j + 1] << 8));
+		}
+		else
+		{
+			if(k > RICE_MAX_K)
+				return false;
+			bitReader r;
+			r.p = p;
+			r.end = p + len;
+			int32_t x1 = 0, x2 = 0;
+			for(int j = 0; j < n; j++)
+			{
+				uint32_t q = 0;
+				while(q < RICE_ESC && getBits(r, 1))
+					q++;
+				uint32_t u = (q == RICE_ESC) ? getBits(r, RICE_RAW_BITS) : (q << k) | (k ? getBits(r, k) : 0);
+				int32_t res = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+				int32_t s = res + 2 * x1 - x2;
+				s = (s > 32767) ? 32767 : (s < -32768) ? -32768 : s;	// only a malformed frame leaves int16: keep the predictor bounded
+				d[j] = (int16_t)s;
+				x2 = x1;
+				x1 = s;
+			}
+			if(r.under)
+				return false;
+		}
+		p += len;
+	}
+	return true;
+}
+
+/******** frames ********/
+int netEncode(netCodec codec, const int16_t * const *src, int channels, int n, adpcmState *state, uint8_t *dst)
+{
+	dst[0] = codec;
+	dst[1] = 0;
+	if(codec == NET_CODEC_ADPCM)
+		return NET_CODEC_HDR + encodeAdpcm(src, channels, n, state, dst + NET_CODEC_HDR);
+	return NET_CODEC_HDR + encodeLossless(src, channels, n, dst + NET_CODEC_HDR);
+}
+
+bool netDecode(const uint8_t *src, int bytes, int channels, int n, int16_t * const *dst, int dstChannels)
+{
+	if(bytes < NET_CODEC_HDR || n > NET_FRAME_MAX)
+		return false;
+	switch(src[0])
+	{
+		case NET_CODEC_ADPCM :
+			return decodeAdpcm(src + NET_CODEC_HDR, bytes - NET_CODEC_HDR, channels, n, dst, dstChannels);
+		case NET_CODEC_LOSSLESS :
+			return decodeLossless(src + NET_CODEC_HDR, bytes - NET_CODEC_HDR, channels, n, dst, dstChannels);
+	}
+	return false;
+}
+
+int netCodecMaxSamples(netCodec codec, int channels)
+{
+	int perChannel = (VBAN_MAX_DATA - NET_CODEC_HDR) / channels;	// payload bytes
+	int n;
+	switch(codec)
+	{
+		case NET_CODEC_ADPCM :
+			n = (perChannel - NET_ADPCM_CH_HDR) * 2;
+			break;
+		case NET_CODEC_LOSSLESS :
+			n = (perChannel - NET_LOSSLESS_CH_HDR) / 2;	// a channel sent as PCM
+			break;
+		default :
+			n = VBAN_MAX_DATA / (channels * 2);
+			break;
+	}
+	return (n > NET_FRAME_MAX) ? NET_FRAME_MAX : n;
+}
@@ -0,0 +1,141 @@
+/* Packet loss concealment for AudioInputNet
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include "conceal_net.h"
+
+#define PLC_MASK (PLC_HISTORY - 1)
+
+// history is not written while concealing, so the substitute keeps reading the audio from before the gap
+void Concealer::record(int16_t * const *dst, int channels, int offset, int n)
+{
+	if(_active || n <= 0)
+		return;
+	if(channels > _channels)
+		channels = _channels;
+	for(int ch = 0; ch < channels; ch++)
+	{
+		const int16_t *src = dst[ch] + offset;
+		int16_t *hist = _hist + ch * PLC_HISTORY;
+		int h = _hp;
+		for(int k = 0; k < n; k++)
+		{
+			hist[h] = src[k];
+			h = (h + 1) & PLC_MASK;
+		}
+	}
+	_hp = (_hp + n) & PLC_MASK;
+	_recorded += n;
+}
+
+void Concealer::conceal(int16_t * const *dst, int channels, int offset, int n)
+{
+	if(n <= 0)
+		return;
+	if(!_active)
+	{
+		_active = true;
+		events++;
+		_pos = 0;
+		_end = _hp;
+		_period = (_mode == PLC_PITCH) ? findPeriod() : AUDIO_BLOCK_SAMPLES;
+	}
+	bool silent = (_mode == PLC_SILENCE || _recorded < (uint32_t)_period);
+	for(int ch = 0; ch < channels; ch++)
+	{
+		int16_t *out = dst[ch] + offset;
+		for(int k = 0; k < n; k++)
+			out[k] = (silent || ch >= _channels) ? 0 : next(ch, _pos + k);
+	}
+	_pos += n;
+	concealedSamples += n;
+}
+
+void Concealer::resume(int16_t * const *dst, int channels, int offset, int n)
+{
+	if(!_active)
+		return;
+	bool silent = (_mode == PLC_SILENCE || _recorded < (uint32_t)_period);
+	int len = (n < PLC_XFADE) ? n : PLC_XFADE;
+	for(int ch = 0; ch < channels; ch++)
+	{
+		int16_t *out = dst[ch] + offset;
+		for(int k = 0; k < len; k++)
+		{
+			int32_t sub = (silent || ch >= _channels) ? 0 : next(ch, _pos + k);
+			out[k] = (int16_t)((out[k] * (k + 1) + sub * (PLC_XFADE - k - 1)) / PLC_XFADE);
+		}
+	}
+	_active = false;
+	record(dst, channels, offset, n);
+}
+
+// repeat the last _period samples before the gap: full level, then fade out
+int16_t Concealer::next(int ch, int k)
+{
+	if(k >= PLC_HOLD + PLC_FADE)
+		return 0;
+	int32_t s = _hist[ch * PLC_HISTORY + ((_end - _period + (k % _period)) & PLC_MASK)];
+	if(k > PLC_HOLD)
+		s = s * (PLC_HOLD + PLC_FADE - k) / PLC_FADE;
+	return (int16_t)s;
+}
+
+// squared normalised correlation between the PLC_PITCH_WINDOW samples from start and those period p earlier, every step'th sample
+static float pitchCorr(const int16_t *h, int start, int p, int step)
+{
+	float xx = 0, xy = 0, yy = 0;
+	for(int i = 0; i < PLC_PITCH_WINDOW; i += step)
+	{
+		float x = h[(start + i) & PLC_MASK];
+		float y = h[(start - p + i) & PLC_MASK];
+		xx += x * x;
+		xy += x * y;
+		yy += y * y;
+	}
+	if(xy <= 0 || yy == 0)
+		return 0;
+	return (xy * xy) / (xx * yy);
+}
+
+// pitch period of channel 0 just before the gap: best normalised correlation between the last
+// PLC_PITCH_WINDOW samples and the same length one trial period earlier.
+// This runs in update() when a gap starts, so the search is coarse (every other period, every other sample),
+// then refined around the best at full resolution: about a seventh of the work of a full search
+int Concealer::findPeriod(void)
+{
+	if(_recorded < PLC_PITCH_WINDOW + PLC_MAX_PERIOD)
+		return AUDIO_BLOCK_SAMPLES;
+	const int16_t *h = _hist;
+	int start = _end - PLC_PITCH_WINDOW;
+	float best = 0;
+	int bestPeriod = 0;
+	for(int p = PLC_MIN_PERIOD; p <= PLC_MAX_PERIOD; p += 2)
+	{
+		float r2 = pitchCorr(h, start, p, 2);
+		if(r2 > best)
+		{
+			best = r2;
+			bestPeriod = p;
+		}
+	}
+	if(bestPeriod == 0) // silence, or nothing correlates
+		return AUDIO_BLOCK_SAMPLES;
+	int coarse = bestPeriod;
+	best = 0;
+	for(int p = coarse - 1; p <= coarse + 1; p++)
+	{
+		if(p < PLC_MIN_PERIOD || p > PLC_MAX_PERIOD)
+			continue;
+		float r2 = pitchCorr(h, start, p, 1);
+		if(r2 > best)
+		{
+			best = r2;
+			bestPeriod = p;
+		}
+	}
+	return (best >= 0.25f) ? bestPeriod : AUDIO_BLOCK_SAMPLES; // correlation below 0.5: not pitched
+}
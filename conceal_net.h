@@ -0,0 +1,66 @@
+/* Packet loss concealment for AudioInputNet
+ *
+ * Keeps a short history of every channel's output. When samples are missing (lost packets or an empty queue)
+ * conceal() fills the gap so that downstream objects always get a full block:
+ *	PLC_SILENCE		zeros
+ *	PLC_REPEAT		the last block, repeated
+ *	PLC_PITCH			the last pitch period, repeated (waveform substitution). Falls back to PLC_REPEAT for unpitched audio.
+ * Repeated audio is held for PLC_HOLD samples, then faded out over PLC_FADE samples.
+ * When real samples return, resume() cross-fades into them over PLC_XFADE samples.
+ * History (channels * PLC_HISTORY samples) is provided by the owner, sized for its channel count.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _CONCEAL_NET_H_
+#define _CONCEAL_NET_H_
+
+#include <stdint.h>
+#include "audio_net.h"
+
+enum plcMode {PLC_SILENCE, PLC_REPEAT, PLC_PITCH};
+#define PLC_DEFAULT_MODE	PLC_PITCH
+
+#define PLC_MIN_PERIOD		32		// pitch search range (samples): 1378 Hz ..
+#define PLC_MAX_PERIOD		256		// .. 172 Hz
+#define PLC_PITCH_WINDOW	128		// samples correlated for each trial period
+#define PLC_HOLD					AUDIO_BLOCK_SAMPLES			// full level
+#define PLC_FADE					(AUDIO_BLOCK_SAMPLES * 3)	// then fade to silence
+#define PLC_XFADE					32		// back into real audio
+#define PLC_MAX_GAP				8			// lost packets larger than this aren't filled (e.g. a sender restart)
+
+class Concealer
+{
+public:
+	Concealer(int16_t *hist, int channels) : _channels(channels), _hist(hist) {}
+
+	void setMode(plcMode mode) { _mode = mode; }
+	plcMode mode(void) { return _mode; }
+
+	// dst[ch] + offset: n samples for each of the channels
+	void record(int16_t * const *dst, int channels, int offset, int n);		// samples that were output
+	void conceal(int16_t * const *dst, int channels, int offset, int n);	// fill a gap
+	void resume(int16_t * const *dst, int channels, int offset, int n);		// real samples have been written: cross-fade into them
+	bool active(void) { return _active; }
+
+	uint32_t concealedSamples = 0;
+	uint32_t events = 0;	// number of separate gaps
+
+private:
+	int findPeriod(void);
+	int16_t next(int ch, int k);	// k'th substitute sample for channel ch
+
+	plcMode _mode = PLC_DEFAULT_MODE;
+	bool _active = false;
+	int _period = AUDIO_BLOCK_SAMPLES;
+	int _end = 0;					// history index at the start of the gap
+	uint32_t _pos = 0;		// substitute samples produced in this gap
+	uint32_t _recorded = 0;
+	int _hp = 0;					// next history write
+	int _channels;
+	int16_t *_hist;				// [_channels][PLC_HISTORY]
+};
+
+#endif
@@ -3,7 +3,7 @@
  * Handles all user-facing Network queue management
  * does NOT take update_responsibility
  *
- * All audio queue manipulation must be with **interrupts off**
+ * Audio queues are lock-free SPSC rings (spsc_queue.h): no interrupt masking is needed
  *
  * Based on QNEthernet library for Teensy 4.1 Shawn Silverman
  *
@@ -14,13 +14,10 @@
 
 #include <Arduino.h>
 #include "control_ethernet.h"
-#include <QNEthernet.h>
 #include "IPAddress.h"
 
 // debug shared with ce_transport
 
-using namespace qindesign::network;
-
 //using namespace AudioControlEtherTransport;
 
 char vban_sub_protocol_name [][8]{"AUDIO", "SERIAL", "TEXT", "SERVICE"};
@@ -29,7 +26,7 @@ uint32_t VBAN_AUDIO_SRList[VBAN_AUDIO_SR_MAXNUMBER]= {6000, 12000, 24000, 48000,
 
 char VBAN_AUDIO_dataType_name[VBAN_AUDIO_TYPE_MAXNUMBER][8] = {"BYTE8", "INT16", "INT24", "INT32", "FLOAT32", "FLOAT64", "BITS12", "BITS10"};
 
-char VBAN_AUDIO_CODEC_name[VBAN_AUDIO_CODEC_MAXNUMBER][5] = {"PCM", "VBCA", "VBCV"};
+char VBAN_AUDIO_CODEC_name[VBAN_AUDIO_CODEC_MAXNUMBER][5] = {"PCM", "VBCA", "VBCV", "?", "?", "?", "?", "?", "?", "?", "?", "?", "?", "?", "?", "USER"};
 
 uint32_t VBAN_BPSList[VBAN_BPS_MAXNUMBER]= {0, 110, 150, 300, 600, 1200, 2400, 4800, 9600, 14400, 19200, 31250, 38400, 57600, 115200, 128000, 230400, 250000, 256000, 460800, 921600, 1000000, 1500000, 2000000, 3000000};
 
@@ -50,7 +47,7 @@ bool AudioControlEthernet::begin()
 int AudioControlEthernet::getHardwareStatus(void) 
 { 
 // disabled - causes immediate SPI call
-	return Ethernet.hardwareStatus();
+	return (etherTran.net) ? etherTran.net->hardwareStatus() : 0;
 }
 
 int AudioControlEthernet::droppedPkts(bool reset)
@@ -63,6 +60,46 @@ int AudioControlEthernet::droppedPkts(bool reset)
 	return temp - resetAt;
 }
 
+int AudioControlEthernet::deferredPkts(bool reset)
+{
+	static uint32_t resetAt = 0;
+	uint32_t temp = etherTran.txDeferred - resetAt;
+	if(reset)
+		resetAt = etherTran.txDeferred;
+	return temp;
+}
+
+void AudioControlEthernet::setTxBudget(int pkts)
+{
+	etherTran.setTxBudget(pkts);
+}
+
+bool AudioControlEthernet::setTxPacing(txPaceMode mode, uint32_t intervalUs)
+{
+	return etherTran.setTxPacing(mode, intervalUs);
+}
+
+void AudioControlEthernet::setNetBudget(int pkts, uint32_t us)
+{
+	etherTran.setNetBudget(pkts, us);
+}
+
+int AudioControlEthernet::budgetHits(bool reset)
+{
+	int temp = etherTran.budgetHits;
+	if(reset)
+		etherTran.budgetHits = 0;
+	return temp;
+}
+
+uint32_t AudioControlEthernet::maxNetTime(bool reset)
+{
+	uint32_t temp = etherTran.maxNetUs;
+	if(reset)
+		etherTran.maxNetUs = 0;
+	return temp;
+}
+
 // end user host info
 hostInfo AudioControlEthernet::getHost(int id) // end user call
 {
@@ -99,10 +136,11 @@ stream_pretty AudioControlEthernet::getStreamInfo(int id, int direction)
 	st.sampleRate = VBAN_AUDIO_SRList[sp->hdr.format_SR & VBAN_SPEEDMASK];
 	st.protocol = sp->hdr.format_SR & VBAN_PROTOCOL_MASK;
 	strcpy(st.dataType, VBAN_AUDIO_dataType_name[sp->hdr.format_bit & VBAN_TYPE_MASK]);
-	strcpy(st.codec, VBAN_AUDIO_CODEC_name[(sp->hdr.format_bit >> VBAN_PROTO_SHIFT) & VBAN_TYPE_MASK]);
+	strcpy(st.codec, VBAN_AUDIO_CODEC_name[(sp->hdr.format_bit & VBAN_AUDIO_CODEC_MASK) >> VBAN_AUDIO_CODEC_SHIFT]);
 	st.pktSamples = sp->hdr.format_nbs + 1;
 	st.channels= sp->hdr.format_nbc + 1;
 	st.lastPktTime = sp->lastPktTime;
+	st.driftPpm = (direction == STREAM_IN) ? sp->driftPpm : 0;
 	st.ipAddress = sp->remoteIP;
 	if(sp->hostIndx == EOQ) // not matched to a host
 		strcpy(st.hostName, "*");
@@ -172,7 +210,7 @@ void AudioControlEthernet::setColour(uint32_t colour)
 void AudioControlEthernet::setPort(uint16_t cPort) 
 {		// set the UDP port for comms
 		etherTran._udpPort = cPort;
-		//udp.begin(cPort); // requires a restart to take effect
+		//etherTran.net->begin(cPort); // requires a restart to take effect
 }
 
 void AudioControlEthernet::printHosts()
@@ -30,8 +30,8 @@ class AudioControlEthernet : public AudioControl//, public AudioStream
 {
 public: // AudioStream is input: must we transmit()?
 	AudioControlEthernet(void) { }  	
-	friend class AudioOutputNet; // work with others sharing this control
-	friend class AudioInputNet;		// may not need these - AudioControlEthernet bridges between
+	friend class AudioOutputNetBase; // work with others sharing this control
+	friend class AudioInputNetBase;		// may not need these - AudioControlEthernet bridges between
 	friend class AudioControlEtherTransport;
 
  // Returns a string containing the library version number.
@@ -62,6 +62,13 @@ public: // AudioStream is input: must we transmit()?
 	subscription getSubInfo(int id) { return etherTran.subsIn[id]; }
 	void printHosts();
 	int droppedPkts(bool reset = true);	// get and reset the number of dropped frames
+	int deferredPkts(bool reset = true);	// outgoing packets that had to wait for a later updateNet() pass
+	void setTxBudget(int pkts);	// outgoing packets sent per stream on each updateNet() pass
+	bool setTxPacing(txPaceMode mode, uint32_t intervalUs = 0); // send from yield() (default), audio update() or a hardware timer. false: fell back to yield()
+	void setNetBudget(int pkts, uint32_t us = 0); // most packets / uS of receive processing per yield() (0: no limit)
+	int budgetHits(bool reset = true);	// number of yield() calls that stopped at the budget
+	uint32_t maxNetTime(bool reset = true);	// longest time (uS) spent in one yield() call
+	uint32_t ramFootprint(void) { return netRamFootprint<NetConfig>(); } // bytes used by the transport and queues, all streams in use
 	int getActiveStreams() ; // number of active strams
 
 
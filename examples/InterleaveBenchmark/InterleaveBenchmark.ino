@@ -0,0 +1,101 @@
+// Interleave benchmark for Teensy Ethernet Audio Library
+// Requires:  one Teensy 4.1. No network connection is needed.
+
+/* Times the interleave_net.h kernels against the plain per-sample loops they replaced:
+    de-interleave: AudioInputNet, one VBAN frame into audio blocks
+    interleave:    AudioOutputNet, audio blocks (one channel unconnected) into a VBAN frame
+  Results are CPU cycles per 128 sample frame, averaged over many runs, for 1, 2, 4, 6 and 8 channels.
+  Each result is checked against the plain loop.
+*/
+
+#include <Audio.h>
+#include "interleave_net.h"
+
+#define SAMPLES 128
+#define RUNS    1000
+#define CHANS   8
+
+int16_t frame[SAMPLES * CHANS];
+int16_t blocks[CHANS][SAMPLES];
+int16_t check[CHANS][SAMPLES];
+int16_t frameCheck[SAMPLES * CHANS];
+
+// the loops used before the kernels
+void plainDeinterleave(const int16_t *src, int channels, int16_t **dst, int dstChannels, int n)
+{
+  for (int i = 0; i < dstChannels; i++)
+  {
+    int16_t *d = dst[i];
+    if(i < channels)
+      for (int j = 0; j < n; j++)
+        d[j] = src[j * channels + i];
+    else
+      memset(d, 0, n * sizeof(int16_t));
+  }
+}
+
+void plainInterleave(int16_t **src, int channels, int16_t *dat, int n)
+{
+  for(int j = 0; j < n; j++)
+    for(int i = 0; i < channels; i++)
+      dat[j * channels + i] = (src[i] == nullptr) ? 0 : src[i][j];
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  while (!Serial && millis() < 5000)
+  {
+    delay(10);
+  }
+  Serial.println("\n\nInterleave benchmark: cycles per 128 sample frame");
+
+  for(int i = 0; i < SAMPLES * CHANS; i++)
+    frame[i] = random(-32768, 32767);
+
+  int chans[] = {1, 2, 4, 6, 8};
+  for(int c : chans)
+  {
+    int16_t *dst[CHANS], *chk[CHANS];
+    for(int i = 0; i < c; i++)
+    {
+      dst[i] = blocks[i];
+      chk[i] = check[i];
+    }
+
+    uint32_t t0 = ARM_DWT_CYCCNT;
+    for(int r = 0; r < RUNS; r++)
+      plainDeinterleave(frame, c, chk, c, SAMPLES);
+    uint32_t plainIn = (ARM_DWT_CYCCNT - t0) / RUNS;
+
+    t0 = ARM_DWT_CYCCNT;
+    for(int r = 0; r < RUNS; r++)
+      deinterleave16(frame, c, dst, c, SAMPLES);
+    uint32_t kernIn = (ARM_DWT_CYCCNT - t0) / RUNS;
+    bool okIn = memcmp(blocks, check, sizeof(int16_t) * SAMPLES * c) == 0;
+
+    int16_t *src[CHANS];
+    for(int i = 0; i < c; i++)
+      src[i] = (i == c - 1 && c > 1) ? nullptr : blocks[i]; // last channel unconnected
+
+    t0 = ARM_DWT_CYCCNT;
+    for(int r = 0; r < RUNS; r++)
+      plainInterleave(src, c, frameCheck, SAMPLES);
+    uint32_t plainOut = (ARM_DWT_CYCCNT - t0) / RUNS;
+
+    int16_t out[SAMPLES * CHANS];
+    t0 = ARM_DWT_CYCCNT;
+    for(int r = 0; r < RUNS; r++)
+      interleave16(src, c, out, SAMPLES);
+    uint32_t kernOut = (ARM_DWT_CYCCNT - t0) / RUNS;
+    bool okOut = memcmp(out, frameCheck, sizeof(int16_t) * SAMPLES * c) == 0;
+
+    Serial.printf("%i ch: de-interleave %5u -> %5u %s,  interleave %5u -> %5u %s\n", c,
+      plainIn, kernIn, okIn ? "ok" : "MISMATCH", plainOut, kernOut, okOut ? "ok" : "MISMATCH");
+  }
+  Serial.println("Done");
+}
+
+void loop()
+{
+}
@@ -0,0 +1,147 @@
+/* VBAN sample format decoding for AudioInputNet
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <string.h>
+#include <math.h>
+#include "format_net.h"
+#if defined(TEENSYDUINO)
+	#include "utility/dspinst.h"	// saturate16(): SSAT
+#endif
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+static inline int16_t sat16(int32_t x)
+{
+#if defined(TEENSYDUINO)
+	return saturate16(x);
+#else
+	return (x > 32767) ? 32767 : (x < -32768) ? -32768 : (int16_t)x;
+#endif
+}
+
+// triangular noise, -255 .. 255 (1/256 LSB)
+static inline int32_t tpdf(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return (int32_t)(x & 0xFF) - (int32_t)((x >> 8) & 0xFF);
+}
+
+static inline int32_t load32(const uint8_t *p)
+{
+	int32_t v;
+	memcpy(&v, p, sizeof(v)); // little endian, as VBAN
+	return v;
+}
+
+static void decodeByte8(const uint8_t *src, int stride, int16_t *dst, int n, uint32_t *) // widening: no dither
+{
+	for(int j = 0; j < n; j++)
+		dst[j] = (int16_t)((int8_t)src[j * stride] * 256);
+}
+
+static void decodeInt16(const uint8_t *src, int stride, int16_t *dst, int n, uint32_t *)
+{
+	for(int j = 0; j < n; j++)
+		dst[j] = *(const int16_t *)(src + j * stride);
+}
+
+static void decodeInt24(const uint8_t *src, int stride, int16_t *dst, int n, uint32_t *dither)
+{
+	for(int j = 0; j < n; j++)
+	{
+		const uint8_t *p = src + j * stride;
+		if(dither == nullptr)
+			dst[j] = (int16_t)(p[1] | (p[2] << 8));	// top 16 bits
+		else
+		{
+			int32_t v = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8;
+			dst[j] = sat16((v + tpdf(dither)) >> 8);
+		}
+	}
+}
+
+static void decodeInt32(const uint8_t *src, int stride, int16_t *dst, int n, uint32_t *dither)
+{
+	int j = 0;
+	if(dither != nullptr)
+	{
+		for(; j < n; j++)
+			dst[j] = sat16(((load32(src + j * stride) >> 8) + tpdf(dither)) >> 8);
+		return;
+	}
+#if defined(__SSE2__)
+	for(; j + 4 <= n; j += 4)
+	{
+		const uint8_t *p = src + j * stride;
+		__m128i v = _mm_set_epi32(load32(p + 3 * stride), load32(p + 2 * stride), load32(p + stride), load32(p));
+		v = _mm_srai_epi32(v, 16);
+		_mm_storel_epi64((__m128i *)(dst + j), _mm_packs_epi32(v, v));
+	}
+#endif
+	for(; j < n; j++)
+		dst[j] = (int16_t)(load32(src + j * stride) >> 16);
+}
+
+static void decodeFloat32(const uint8_t *src, int stride, int16_t *dst, int n, uint32_t *dither)
+{
+	int j = 0;
+	float f;
+	if(dither != nullptr)
+	{
+		for(; j < n; j++)
+		{
+			memcpy(&f, src + j * stride, sizeof(f));
+			float x = f * 32768.0f + tpdf(dither) * (1.0f / 256);
+			dst[j] = (x >= 32767.0f) ? 32767 : (x <= -32768.0f) ? -32768 : (int16_t)lrintf(x);
+		}
+		return;
+	}
+#if defined(__SSE2__)
+	const __m128 scale = _mm_set1_ps(32768.0f);
+	for(; j + 4 <= n; j += 4)
+	{
+		const uint8_t *p = src + j * stride;
+		float x[4];
+		for(int k = 0; k < 4; k++)
+			memcpy(&x[k], p + k * stride, sizeof(float));
+		__m128i v = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(x), scale)); // out of range: INT32_MIN, which saturates below
+		_mm_storel_epi64((__m128i *)(dst + j), _mm_packs_epi32(v, v));
+	}
+#endif
+	for(; j < n; j++)
+	{
+		memcpy(&f, src + j * stride, sizeof(f));
+		float x = f * 32768.0f;
+		dst[j] = (x >= 32767.0f) ? 32767 : (x <= -32768.0f) ? -32768 : (int16_t)lrintf(x);
+	}
+}
+
+// indexed by VBAN_AUDIO_dataType
+static const vbanFormat vbanFormats[VBAN_AUDIO_TYPE_MAXNUMBER] =
+{
+	{1, decodeByte8},
+	{2, decodeInt16},
+	{3, decodeInt24},
+	{4, decodeInt32},
+	{4, decodeFloat32},
+	{8, nullptr},		// FLOAT64
+	{0, nullptr},		// BITS12
+	{0, nullptr}		// BITS10
+};
+
+const vbanFormat *vbanDecoder(uint8_t format_bit)
+{
+	if((format_bit & VBAN_AUDIO_CODEC_MASK) != PCM)
+		return nullptr;
+	const vbanFormat *f = &vbanFormats[format_bit & VBAN_TYPE_MASK];
+	return (f->decode == nullptr) ? nullptr : f;
+}
@@ -0,0 +1,32 @@
+/* VBAN sample format decoding for AudioInputNet
+ *
+ * One kernel per VBAN data type (format_bit) converts one channel of an interleaved payload to 16 bit samples,
+ * so decoding and de-interleaving are a single pass. The kernel is chosen once per stream with vbanDecoder().
+ *	BYTE8, INT16, INT24, INT32 (little endian, signed) and FLOAT32 (+/-1.0 full scale) are supported, PCM codec only.
+ * Formats with more than 16 bits may be TPDF dithered down to 16 bits (one LSB peak).
+ * x86 builds (the POSIX backend) use SSE2 for undithered INT32 and FLOAT32. Teensy uses the Cortex-M7 saturating instructions.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _FORMAT_NET_H_
+#define _FORMAT_NET_H_
+
+#include <stdint.h>
+#include "audio_vban.h"
+
+// n samples of one channel: src points at its first sample, stride is the bytes between its samples (channels * bytes)
+// dither: generator state, nullptr for none
+typedef void (*sampleDecoder)(const uint8_t *src, int stride, int16_t *dst, int n, uint32_t *dither);
+
+struct vbanFormat
+{
+	uint8_t bytes;					// per sample
+	sampleDecoder decode;
+};
+
+const vbanFormat *vbanDecoder(uint8_t format_bit);	// nullptr: not supported
+
+#endif
@@ -0,0 +1,95 @@
+/* Common playout latency for several AudioInputNet objects
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include "group_net.h"
+#include "input_net.h"
+
+bool StreamGroup::add(AudioInputNetBase &in)
+{
+	if(in._group == this)
+		return true;
+	if(in._group != nullptr)
+		return false;
+	for(int i = 0; i < GROUP_MAX_MEMBERS; i++)
+	{
+		if(_member[i] == nullptr)
+		{
+			AudioNoInterrupts(); // update() may be running the group
+			_member[i] = &in;
+			_live[i] = false;
+			in._groupSlot = i;
+			in._groupEpoch = epoch() - 1; // aligns on its next update()
+			in._group = this;
+			AudioInterrupts();
+			return true;
+		}
+	}
+	return false;
+}
+
+void StreamGroup::remove(AudioInputNetBase &in)
+{
+	if(in._group != this)
+		return;
+	AudioNoInterrupts();
+	_member[in._groupSlot] = nullptr;
+	_live[in._groupSlot] = false;
+	in._group = nullptr;
+	in._jb.hold(0);
+	AudioInterrupts();
+}
+
+void StreamGroup::setLatency(int samples)
+{
+	_fixed = (samples > 0) ? samples : 0;
+	if(_fixed)
+	{
+		_latency = _fixed;
+		resync();
+	}
+}
+
+uint32_t StreamGroup::latencyUs(void)
+{
+	return (uint64_t)_latency * 1000000 / (uint32_t)AUDIO_SAMPLE_RATE_EXACT;
+}
+
+int StreamGroup::spread(void)
+{
+	int lo = 0, hi = 0;
+	bool any = false;
+	for(int i = 0; i < GROUP_MAX_MEMBERS; i++)
+	{
+		if(_member[i] == nullptr || !_live[i])
+			continue;
+		if(!any || _delay[i] < lo)
+			lo = _delay[i];
+		if(!any || _delay[i] > hi)
+			hi = _delay[i];
+		any = true;
+	}
+	return hi - lo;
+}
+
+// Members report in turn from the audio update. The latency follows the neediest member:
+// down gradually (as its target shrinks), and up at once, with a resync if it jumps
+int StreamGroup::report(int slot, int delay, int want)
+{
+	_delay[slot] = delay;
+	_want[slot] = want;
+	_live[slot] = true;
+	if(_fixed)
+		return _fixed;
+	int latency = 0;
+	for(int i = 0; i < GROUP_MAX_MEMBERS; i++)
+		if(_member[i] != nullptr && _live[i] && _want[i] > latency)
+			latency = _want[i];
+	if(latency > _latency + GROUP_TOLERANCE)
+		resync();
+	_latency = latency;
+	return _latency;
+}
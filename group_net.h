@@ -0,0 +1,57 @@
+/* Common playout latency for several AudioInputNet objects
+ *
+ * Each input's jitter buffer settles at its own depth, and packets from different senders reach us at different
+ * points in our audio cycle, so separate streams play with different delays (several mS apart).
+ * A StreamGroup holds all of its members at one playout delay: from the arrival of a stream's newest frame to
+ * the sample being played, i.e. the frames still to play (by nuFrame, lost ones included) plus the time since that frame arrived.
+ * Streams whose senders start capturing together, over similar network paths, then play together.
+ *	- latency: setLatency(), or (0, default) the largest target any member's jitter calls for
+ *	- each member's rate converter holds its delay at the latency (jitter_net.h)
+ *	- resync: after losses, an underrun or a jump in the latency, every member is checked in the same audio cycle.
+ *	  Those more than GROUP_TOLERANCE (plus their jitter) out skip samples or pre-roll, so they come back together.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _GROUP_NET_H_
+#define _GROUP_NET_H_
+
+#include <stdint.h>
+#include <atomic>
+#include "audio_net.h"
+
+#define GROUP_MAX_MEMBERS		8
+#define GROUP_TOLERANCE			AUDIO_BLOCK_SAMPLES		// samples a member may stray from the latency before a resync
+
+class AudioInputNetBase;
+
+class StreamGroup
+{
+public:
+	bool add(AudioInputNetBase &in);			// false: group full, or the input is in another group
+	void remove(AudioInputNetBase &in);
+	void setLatency(int samples);					// playout delay at our rate. 0 (default): automatic
+	int latency(void) { return _latency; }
+	uint32_t latencyUs(void);
+	int spread(void);											// largest difference between members' delays at their last update (samples)
+	void resync(void) { _epoch.fetch_add(1); resyncs.fetch_add(1); }	// from mainline or the audio update()
+	std::atomic<uint32_t> resyncs {0};
+
+	// members, from update()
+	int report(int slot, int delay, int want);	// this member's delay and the latency it needs. Returns the latency
+	void idle(int slot) { _live[slot] = false; }	// no stream
+	uint32_t epoch(void) { return _epoch.load(); }
+
+private:
+	AudioInputNetBase *_member[GROUP_MAX_MEMBERS] = {nullptr};
+	int _delay[GROUP_MAX_MEMBERS];
+	int _want[GROUP_MAX_MEMBERS];
+	bool _live[GROUP_MAX_MEMBERS] = {false};
+	int _fixed = 0;
+	int _latency = AUDIO_BLOCK_SAMPLES * 2;
+	std::atomic<uint32_t> _epoch {0};
+};
+
+#endif
@@ -31,7 +31,7 @@ void AudioInputServiceNet::begin(void)
 // number of queued packects
 bool AudioInputServiceNet::available(void) 
 {
-	if(etherTran.subsIn[_mySubI].streamID == EOQ) // don't provide data until subscription is active 
+	if(etherTran.getStreamFromSub(_mySubI) == EOQ) // don't provide data until subscription is active 
 		return false;
 		
 	return _myQueueI.size(); 
@@ -47,7 +47,7 @@ int AudioInputServiceNet::getPktsInQueue()
 // assumes available(), size of next packet data (excluding headers)
 int AudioInputServiceNet::dataSize(void)
 {
-		return (_myQueueI.size() == 0) ? 0 : _myQueueI.front().samplesUsed; 
+		return (_myQueueI.size() == 0) ? 0 : _myQueueI.front()->samplesUsed; 
 }
 
 queuePkt AudioInputServiceNet::getPkt()
@@ -60,11 +60,10 @@ queuePkt AudioInputServiceNet::getPkt()
 		
 	//Serial.printf("+++++ Getting pkt, qptr %X\n", _myQueueI);
 	// extract data length from packet size
-	cli(); // not called by update()
-	_pkt = _myQueueI.front();
-	//	memcpy((void*)&_pkt, (void*)&(_myQueueI.front()), sizeof(_pkt)); // whole packet
-		_myQueueI.pop();
-	sei();
+	queuePkt *slot = _myQueueI.front();
+	memcpy((void*)&_pkt, (void*)slot, QPKT_HDR_SIZE + slot->samplesUsed); // header and data only
+	_myQueueI.pop();
+	etherTran.rxPool.release(slot);
 #ifdef IS_DEBUG
 //		Serial.printf("Got a Service Pkt '%c', qptr %X\n", _pkt.c.content[0], _myQueueI);
 	#endif
@@ -81,8 +80,8 @@ queuePkt AudioInputServiceNet::getPkt()
 // register this object with subscriptions, hostname defaults to nullptr
 int AudioInputServiceNet::subscribe(char * streamName, uint8_t sType, char * hostName)
 {
-	if(_myStreamI != EOQ) // already subscribed
-		return _myStreamI;
+	if(_mySubI != EOQ) // already subscribed
+		return _mySubI;
 	int i;
 	int emptySlot = EOQ;
 	for (i = 0; i < MAX_SUBSCRIPTIONS; i++)
@@ -101,14 +100,16 @@ int AudioInputServiceNet::subscribe(char * streamName, uint8_t sType, char * hos
 		etherTran.subsIn[emptySlot].serviceType = sType;
 		etherTran.subsIn[emptySlot].active = true;
 		strncpy(etherTran.subsIn[emptySlot].streamName, streamName, VBAN_STREAM_NAME_LENGTH-1);
+		etherTran.subsIn[emptySlot].ipAddress = IPAddress((uint32_t)0);
+		strcpy(etherTran.subsIn[emptySlot].hostName, "?");
 		if(hostName != nullptr)
 			strncpy(etherTran.subsIn[emptySlot].hostName, hostName, VBAN_HOSTNAME_LEN-1);
 #ifdef IS_DEBUG
 		Serial.printf("--Subscribed to Service In stream  '%s', host '%s', slot %i, queue 0x%04X\n", streamName, etherTran.subsIn[emptySlot].hostName, emptySlot,etherTran.subsIn[emptySlot].qPtr );
 #endif
 		_mySubI = emptySlot;
+		etherTran.bindSubscription(emptySlot); // live now if the stream is already arriving
 		return emptySlot;
-		// other particulars (e.g IP) will be filled in later
 	}
 	else
 		return EOQ;
@@ -117,8 +118,8 @@ int AudioInputServiceNet::subscribe(char * streamName, uint8_t sType, char * hos
 // subscribe by name/IP
 int AudioInputServiceNet::subscribe(char * streamName, uint8_t sType, IPAddress remoteIP)
 {
-	if(_myStreamI != EOQ) // already subscribed
-			return _myStreamI;
+	if(_mySubI != EOQ) // already subscribed
+			return _mySubI;
 	int i;
 	int emptySlot = EOQ;
 	for (i = 0; i < MAX_SUBSCRIPTIONS; i++)
@@ -130,17 +131,20 @@ int AudioInputServiceNet::subscribe(char * streamName, uint8_t sType, IPAddress
 	}
 	if(emptySlot != EOQ) // there's space
 	 {
+		 if(!etherTran.setSubAddress(emptySlot, remoteIP)) // a multicast group is joined
+			 return EOQ;
 		 etherTran.subsIn[emptySlot].qPtr = &_myQueueI;
 		 etherTran.subsIn[emptySlot].active = true;
 		 etherTran.subsIn[emptySlot].protocol = VBAN_SERVICE_SHIFTED;
 		 etherTran.subsIn[emptySlot].serviceType = sType;
 		 strncpy(etherTran.subsIn[emptySlot].streamName, streamName, VBAN_STREAM_NAME_LENGTH-1);
-		 etherTran.subsIn[emptySlot].ipAddress = remoteIP;
+		 strcpy(etherTran.subsIn[emptySlot].hostName, "?");
 #ifdef IS_DEBUG
 		 Serial.printf("Subscribed Service In to '%s', slot %i, IP ", streamName, emptySlot);
 		 Serial.println(remoteIP);
 #endif
 		_mySubI = emptySlot;
+		 etherTran.bindSubscription(emptySlot);
 		 return emptySlot;
 	 }
 	return EOQ;
@@ -149,11 +153,14 @@ int AudioInputServiceNet::subscribe(char * streamName, uint8_t sType, IPAddress
 
 void AudioInputServiceNet::unSubscribe(void)  // release the subscribed stream. 
 {
-	if (_myStreamI >= 0)
+	if (_mySubI != EOQ)
+		etherTran.unbindSubscription(_mySubI);
+	while(_myQueueI.size() > 0) // this is the consumer context, so queued packets can be released here
 	{
-		etherTran.streamsIn[_myStreamI].subscription = EOQ;
-		etherTran.subsIn[_myStreamI].active = false;
+		etherTran.rxPool.release(_myQueueI.front());
+		_myQueueI.pop();
 	}
+	_mySubI = EOQ;
 	_myStreamI = EOQ; 	
 }
 
@@ -40,7 +40,7 @@ public:
 
 	// VBAN stream subscription
 	int subscribe(char * name, uint8_t sType, char * hostName = nullptr); // use this for broadcast
-	int subscribe(char * name, uint8_t sType, IPAddress remoteIP);
+	int subscribe(char * name, uint8_t sType, IPAddress remoteIP); // a multicast remoteIP joins that group (any sender)
 	void unSubscribe(void); // release the subscribed stream. Packets will not be queued.
 
 private:
@@ -48,7 +48,7 @@ private:
 	int getMyStream(void) { return _myStreamI; } // get the ID of my subscribed stream
 	
 	int itim; //debug
-	std::queue <queuePkt> _myQueueI;
+	pktHandleQueue _myQueueI;	// pointers into etherTran.rxPool
 	
 
 	uint16_t _inChans = 1; // only one is supported
@@ -15,7 +15,7 @@
 
 
 
-void AudioInputNet::begin(void)
+void AudioInputNetBase::begin(void)
 {
 	_myStreamI = -1; 	// **** should be unsubscribed: -1
 
@@ -53,9 +53,9 @@ void AudioInputNet::begin(void)
 
 
 //  update() will not be called if there are no connected patchCords
-//  Only transmit if queue has more than low water mark packets.
+//  The jitter buffer (jitter_net.h) decides when there are enough samples queued to transmit.
 
-void AudioInputNet::update(void)
+void AudioInputNetBase::update(void)
 {
 	static bool printMe = false;
 #ifdef IN_DEBUG
@@ -69,17 +69,27 @@ void AudioInputNet::update(void)
 	if(!etherTran.linkIsUp()) //  uninitialised or disconnected
 		return;
 
-	if(_myStreamI == EOQ) // unsubscribed - check for update
+	_myStreamI = etherTran.getStreamFromSub(_mySubI); // follows rebinding
+	if(_myStreamI == EOQ) // unsubscribed or no stream yet
 	{
-		int temp = etherTran.getStreamFromSub(_mySubI);
-		if(temp == EOQ)
+		while(_myQueueI.size() > 0) // left over from an unSubscribe()
 		{
-	//		if(printMe) Serial.printf("*** In Upd no stream %i, %i\n", _myStreamI, inputBegun);
-			return;
+			etherTran.rxPool.release(_myQueueI.front());
+			_myQueueI.pop();
 		}
-		_myStreamI = temp;
+		_decoded = nullptr;
+		qUsedSamples = 0;
+		_gapSamples = 0;
+		_frameValid = false;
+		_jb.reset();
+		_jb.resetDrift();
+		_rs.reset();
+		if(_group != nullptr)
+			_group->idle(_groupSlot);
+		//		if(printMe) Serial.printf("*** In Upd no stream %i, %i\n", _myStreamI, inputBegun);
+		return;
 	}
-	int i, j;	
+	int i;
 	//if(printMe) Serial.printf("![%i,%i]", _myStreamI, _mySubI);
 	
 	if(etherTran.streamsIn[_myStreamI].active == false)
@@ -90,104 +100,250 @@ void AudioInputNet::update(void)
 		return;
 	}
 
-	if(_myQueueI.size() == 0) // no packets to process
+	// jitter buffer: play or pre-roll, and how fast
+	const streamInfo &st = etherTran.streamsIn[_myStreamI];
+	// the jitter buffer works in our samples: queue depth is scaled from the stream's rate
+	int sr = st.hdr.format_SR & VBAN_SPEEDMASK;
+	uint32_t inRate = (sr < VBAN_AUDIO_SR_MAXNUMBER) ? VBAN_AUDIO_SRList[sr] : (uint32_t)AUDIO_SAMPLE_RATE_EXACT;
+	float toLocal = AUDIO_SAMPLE_RATE_EXACT / inRate;
+	int pktSamples = (int)((st.hdr.format_nbs + 1) * toLocal);
+	_buffered = (int)(((int)_myQueueI.size() * (st.hdr.format_nbs + 1) - qUsedSamples) * toLocal);
+	int jitter = (int)((uint64_t)st.jitterUs * (uint32_t)AUDIO_SAMPLE_RATE_EXACT / 1000000);
+	int capacity = (int)(AUDIO_QUEUE_SAMPLES * toLocal) - 2 * pktSamples; // the queue's high water mark, less a packet in flight
+	if(capacity > (AUDIO_QUEUE_HIGH_WATER - 1) * pktSamples)
+		capacity = (AUDIO_QUEUE_HIGH_WATER - 1) * pktSamples;
+	if(capacity < pktSamples + AUDIO_BLOCK_SAMPLES) // large sender packets for a shallow queue (e.g. 256 samples into NetConfigLowLatency)
+		capacity = pktSamples + AUDIO_BLOCK_SAMPLES;
+	int lead = (_group != nullptr) ? groupLead(st, toLocal, pktSamples, jitter) : 0;
+	int take = _jb.plan(_buffered, jitter, pktSamples, capacity, lead);
+
+	// the rate converter runs at the nominal ratio (e.g. 48 kHz to 44.1 kHz), trimmed by the jitter buffer to follow clock drift (resample_net.h)
+	_rs.setRatio(inRate / (double)AUDIO_SAMPLE_RATE_EXACT * (1.0 + _jb.correctionPpm() * 1e-6));
+	int16_t *src[MAXCHANNELS];
+	_rs.input(src, _inChans);
+	int want = _rs.inputNeeded(AUDIO_BLOCK_SAMPLES);
+
+	// a full block is always transmitted: missing samples are concealed (conceal_net.h)
+	if(take == 0) // pre-roll, or ran dry
 	{
 		npiq++;
+		_plc.conceal(src, _inChans, 0, want);
 #ifdef IN_DEBUG
-		if(printMe){Serial.printf("*** In upd NPIQ %i of 500\n", npiq); npiq = 0;}
+		if(printMe){Serial.printf("*** In upd pre-roll, have %i of %i samples\n", _buffered, _jb.target()); npiq = 0;}
 #endif
-		return;
 	}
+	else
+	{
+		int got = readFrames(src, 0, want);
+		if(got < want) // queue ran out part way through
+			_plc.conceal(src, _inChans, got, want - got);
+	}
+	_rs.commit(want);
+
+	int16_t *dst[MAXCHANNELS];
+	for (i = 0; i < _inChans; i++)
+		dst[i] = new_block[i]->data;
+	_rs.process(dst, _inChans, AUDIO_BLOCK_SAMPLES);
+
+	//if(printMe) Serial.printf(" !TX %i, took %i, chans %i\n", _myStreamI, take, _inChans);
+	for (i = 0; i < _inChans; i++) 
+		transmit(new_block[i], i);
+	//if(printMe)	Serial.printf("In pkts %i in Q %i\n",  _mySubI, _myQueueI.size());
+}
+
+// StreamGroup member: measure the playout delay, follow the group's latency, and resync if it has moved too far.
+// Delay: the stream's samples still to play, up to the end of the newest frame (lost and held frames included), plus the time since that frame arrived.
+// Returns the delay less the samples queued, which the jitter buffer adds to its depth.
+int AudioInputNetBase::groupLead(const streamInfo &st, float toLocal, int pktSamples, int jitter)
+{
+	if(st.frameUs == 0)
+		return 0;
+	int samples = st.hdr.format_nbs + 1;
+	int span = _gapSamples;
+	if(_myQueueI.size() > 0)
+		span += (int)(st.hdr.nuFrame - _myQueueI.front()->hdr.nuFrame + 1) * samples - qUsedSamples;
+	int age = (int)((uint64_t)(micros() - st.frameUs) * (uint32_t)AUDIO_SAMPLE_RATE_EXACT / 1000000);
+	_delay = (int)(span * toLocal) + age;
 
-	// while the current buffer set is not filled:
-	// Move samples into audio buffers, using new packets if needed.
-	// It may take up to 3 packets to fill the buffers if the initial one has only a few samples left (min observed samples/pkt = 89).
-	int usedPkts = 1;
-	queuePkt * pkt;
-	while((_currentBuffer < AUDIO_BLOCK_SAMPLES) && (_myQueueI.size() > 0))
+	int latency = _group->report(_groupSlot, _delay, _jb.ownTarget() + pktSamples / 2); // delay runs half a packet above the samples queued
+	_jb.hold(latency);
+	int tol = GROUP_TOLERANCE + 2 * jitter;
+	if(!_jb.prerolling() && (_delay > latency + tol || _delay < latency - tol)) // lost frames, a burst, or the latency has jumped
+		_group->resync();
+	if(_groupEpoch != _group->epoch()) // every member checks itself in the same audio cycle
 	{
-		pkt = (queuePkt *)&_myQueueI.front();
+		_groupEpoch = _group->epoch();
+		if(_delay > latency + tol) // late: skip the difference
+		{
+			readFrames(nullptr, 0, (int)((_delay - latency) / toLocal), false);
+			_buffered = (int)(((int)_myQueueI.size() * samples - qUsedSamples) * toLocal);
+			_delay = latency;
+			_jb.rebase(latency);
+		}
+		else if(_delay < latency - tol) // early: pre-roll up to the latency
+			_jb.reset();
+	}
+	return _delay - _buffered;
+}
+
+// Move n samples (per channel) from queued packets to dst[] + offset.
+// The time of lost packets (up to PLC_MAX_GAP) is filled by the concealer, so timing stays sample-continuous.
+// copy == false discards them.
+// Returns the number of samples produced, fewer than n if the queue ran out.
+int AudioInputNetBase::readFrames(int16_t * const *dst, int offset, int n, bool copy)
+{
+	int done = 0;
+	int i;
+	while(done < n)
+	{
+		if(_gapSamples > 0) // lost packets
+		{
+			int count = (_gapSamples < n - done) ? _gapSamples : n - done;
+			if(copy)
+				_plc.conceal(dst, _inChans, offset + done, count);
+			_gapSamples -= count;
+			done += count;
+			continue;
+		}
+		if(_myQueueI.size() == 0)
+			break;
+		queuePkt *pkt = _myQueueI.front(); // samples are read straight from the receive pool slot
 		int channels = pkt->hdr.format_nbc + 1;
 		int samples = pkt->hdr.format_nbs + 1;
-		int available = samples - qUsedSamples;
-		int needed = AUDIO_BLOCK_SAMPLES - _currentBuffer;
-		int copyThisBlock = min(available, needed);
-
 
-		if(pkt->hdr.nuFrame != (_lastQFrameNum + 1)) // dropped packet
+		if(qUsedSamples == 0 && _frameValid && pkt->hdr.nuFrame != (_lastQFrameNum + 1)) // dropped packet
 		{
 			framesDropped++;
 #ifdef IN_DEBUG
 			if(framesDropped % 200 == 0)
 				Serial.printf("++++++ In dropped frame %i, %i, q size %i\n", pkt->hdr.nuFrame, _lastQFrameNum, _myQueueI.size());
 #endif
+			uint32_t lost = pkt->hdr.nuFrame - (_lastQFrameNum + 1);
+			_lastQFrameNum = pkt->hdr.nuFrame - 1;
+			if(lost <= PLC_MAX_GAP)
+			{
+				_gapSamples = lost * samples;
+				continue;
+			}
 		}
-		
-	//if(printMe) Serial.printf("!FC curBuf %i,used %3i,  need %3i, have %3i(copying %3i), chans %i [pkt %i], qSiz %i, frame %i\n", _currentBuffer, qUsedSamples, needed, available,  copyThisBlock, _inChans, channels, _myQueueI.size(), pkt->hdr.nuFrame);
-
-		//if(printMe) print6pkt(pkt, qUsedSamples, (qUsedSamples + copyThisBlock) * channels);
-	
-		for (j = 0; j < copyThisBlock; j++)	// does the order matter? Any prefetch should be better this way
+		int count = samples - qUsedSamples;
+		if(count > n - done)
+			count = n - done;
+		//if(printMe) print6pkt(pkt, qUsedSamples, (qUsedSamples + count) * channels);
+		if(copy)
 		{
+			int16_t *d[MAXCHANNELS];
 			for (i = 0; i < _inChans; i++)
-				if(i < channels) 
-					new_block[i]->data[j + _currentBuffer] = pkt->c.content16[(j + qUsedSamples) * channels + i]; // 16-bit samples
-				else
-					new_block[i]->data[j + _currentBuffer] = 0; // not enough incoming channels to supply all the 
-		}	
-		//if(printMe) print3buf(0, _currentBuffer, _currentBuffer + copyThisBlock);
-		
-		_currentBuffer +=	copyThisBlock;
-		
-		if(available > needed) // More than enough data in this packet. Use the rest for next buffer set.
-		{
-			qUsedSamples += copyThisBlock;	
-#ifdef IN_DEBUG
-			if(_currentBuffer != AUDIO_BLOCK_SAMPLES) Serial.println("*** I upd: Full buffer not full");
-#endif
-			// leave _lastQFrameNum alone: coming back to this packet next time
-				break; // buffer is full, so straight to transmit
+				d[i] = dst[i] + offset + done;
+			if(pkt->hdr.format_bit == NET_FMT_COMPRESSED) // the whole frame is decoded when first read (codec_net.h)
+			{
+				if(_decoded != pkt)
+					decodeFrame(pkt);
+				for (i = 0; i < _inChans && i < channels; i++)
+					memcpy(d[i], _codecBuf + i * NET_FRAME_MAX + qUsedSamples, count * sizeof(int16_t));
+			}
+			else if((pkt->hdr.format_bit & VBAN_TYPE_MASK) == INT16) // all channels in one pass (interleave_net.h)
+				unpack16(&pkt->c.content16[qUsedSamples * channels], channels, d, count);
+			else
+			{
+				const vbanFormat *fmt = format(pkt->hdr.format_bit);
+				int stride = channels * fmt->bytes;
+				const uint8_t *src = &pkt->c.content[qUsedSamples * stride];
+				for (i = 0; i < _inChans && i < channels; i++) // decode and de-interleave (format_net.h)
+					fmt->decode(src + i * fmt->bytes, stride, d[i], count, _dither ? &_ditherState : nullptr);
+			}
+			for (i = channels; i < _inChans; i++) // not enough incoming channels to supply all the outputs
+				memset(d[i], 0, count * sizeof(int16_t));
+			if(_plc.active())
+				_plc.resume(dst, _inChans, offset + done, count);
+			else
+				_plc.record(dst, _inChans, offset + done, count);
 		}
-
-		if (available <= needed) // All samples used - free the packet
+		done += count;
+		qUsedSamples += count;
+		if(qUsedSamples >= samples) // All samples used - free the packet
 		{
-#ifdef IN_DEBUG
-			if(available == needed && _currentBuffer != AUDIO_BLOCK_SAMPLES) Serial.println("*** Full buffer not full _B");
-#endif
 			qUsedSamples = 0;
 			_lastQFrameNum = pkt->hdr.nuFrame; // frame sequence check
-			cli(); // may not be required - already inside software interrupt
-				_myQueueI.pop(); // free used queue packet
-			sei();
+			_frameValid = true;
+			_myQueueI.pop();
+			etherTran.rxPool.release(pkt);
+			_decoded = nullptr; // the slot may be reused
 		}
+	}
+	return done;
+}
 
-		if (available < needed) //  need to get another packet
-		{			
-			usedPkts++;
-		}
-	}	// while - fill buffer set 
-	
-	
-	// transmit full buffers, or come back next time and finish (out of packet warning)
-	if (_currentBuffer ==  AUDIO_BLOCK_SAMPLES)  
-	{		
-		//if(printMe) Serial.printf(" !TX %i, used %i pkts, chans %i\n", _myStreamI, usedPkts, _inChans);
-		// if we got 1 block, all  are filled
-		for (i = 0; i < _inChans; i++) 
-		{
-			transmit(new_block[i], i);
-		}
-		_currentBuffer = 0;
+// decode a compressed frame into _codecBuf. Malformed frames decode as silence
+void AudioInputNetBase::decodeFrame(const queuePkt *pkt)
+{
+	int16_t *d[MAXCHANNELS];
+	for (int i = 0; i < _inChans; i++)
+		d[i] = _codecBuf + i * NET_FRAME_MAX;
+	if(!netDecode(pkt->c.content, pkt->samplesUsed, pkt->hdr.format_nbc + 1, pkt->hdr.format_nbs + 1, d, _inChans))
+		memset(_codecBuf, 0, _inChans * NET_FRAME_MAX * sizeof(int16_t));
+	_decoded = pkt;
+}
+
+// the decode buffer is kept once allocated: compressed frames may still be queued
+bool AudioInputNetBase::setCompressed(bool accept)
+{
+	if(accept && _codecBuf == nullptr)
+	{
+		_codecBuf = (int16_t *)malloc(_inChans * NET_FRAME_MAX * sizeof(int16_t));
+		if(_codecBuf == nullptr)
+			return false;
 	}
-	else{
-		didNotTransmit++;
-#ifdef IN_DEBUG
-		if(printMe) Serial.println("------- !In_update TX! Ran out of queued packets.");	
-#endif
-		//etherTran.cleanAQ_I(); 
+	_compressed = accept;
+	if(_mySubI != EOQ)
+		etherTran.subsIn[_mySubI].compressed = accept;
+	return true;
+}
+
+void AudioInputNetBase::setConcealment(plcMode mode)
+{
+	_plc.setMode(mode);
+}
+
+// the kernel for this stream's sample format is looked up when the format changes
+const vbanFormat *AudioInputNetBase::format(uint8_t format_bit)
+{
+	if(_fmt == nullptr || format_bit != _fmtBit)
+	{
+		_fmt = vbanDecoder(format_bit);
+		_fmtBit = format_bit;
+		if(_fmt == nullptr) // can't happen: packetTest() only queues formats that decode
+			_fmt = vbanDecoder(OK_VBAN_FMT);
 	}
-	//if(printMe)	Serial.printf("In pkts %i in Q %i\n",  _mySubI, _myQueueI.size());
-	return;
+	return _fmt;
+}
+
+void AudioInputNetBase::setReorderWindow(int frames)
+{
+	_reorderFrames = frames;
+	if(_mySubI != EOQ)
+		etherTran.setReorderWindow(_mySubI, frames);
+}
+
+uint32_t AudioInputNetBase::reorderedFrames(void)
+{
+	return (_mySubI == EOQ) ? 0 : etherTran.subsIn[_mySubI].reordered;
+}
+
+void AudioInputNetBase::setJitterProfile(jbProfile profile)
+{
+	_jb.setProfile(profile);
+	_jb.reset();
+}
+
+void AudioInputNetBase::setJitterTarget(int minSamples, int maxSamples)
+{
+	_jb.setTarget(minSamples, maxSamples);
+}
+
+uint32_t AudioInputNetBase::latencyUs(void)
+{
+	return (uint64_t)_buffered * 1000000 / (uint32_t)AUDIO_SAMPLE_RATE_EXACT;
 }
 
 // subscribe to a stream from a (or any) host
@@ -196,10 +352,10 @@ void AudioInputNet::update(void)
 
 // default registration
 // register this object with subscriptions, hostname defaults to nullptr
-int AudioInputNet::subscribe(char * streamName, char * hostName)
+int AudioInputNetBase::subscribe(char * streamName, char * hostName)
 {
-	if(_myStreamI != EOQ) // already subscribed
-		return _myStreamI;
+	if(_mySubI != EOQ) // already subscribed
+		return _mySubI;
 	int i;
 	int emptySlot = EOQ;
 	for (i = 0; i < MAX_SUBSCRIPTIONS; i++)
@@ -213,27 +369,31 @@ int AudioInputNet::subscribe(char * streamName, char * hostName)
 	{
 		// _myStreamI will be matched later
 		etherTran.subsIn[emptySlot].qPtr = &_myQueueI;
-		etherTran.subsIn[emptySlot].protocol = OK_VBAN_AUDIO_PROTO; // only accept 44.1 PCM16
+		etherTran.subsIn[emptySlot].protocol = VBAN_AUDIO_SHIFTED; // any rate: converted by update()
 		etherTran.subsIn[emptySlot].active = true;
 		strncpy(etherTran.subsIn[emptySlot].streamName, streamName, VBAN_STREAM_NAME_LENGTH-1);
+		etherTran.subsIn[emptySlot].ipAddress = IPAddress((uint32_t)0);
+		strcpy(etherTran.subsIn[emptySlot].hostName, "?");
 		if(hostName != nullptr)
 			strncpy(etherTran.subsIn[emptySlot].hostName, hostName, VBAN_HOSTNAME_LEN-1);
 #ifdef IN_DEBUG
 		Serial.printf("--Subscribed Audio In to stream '%s', host '%s', slot %i\n", streamName, etherTran.subsIn[emptySlot].hostName, emptySlot);
 #endif
 		_mySubI = emptySlot;
+		etherTran.setReorderWindow(emptySlot, _reorderFrames);
+		etherTran.subsIn[emptySlot].compressed = _compressed;
+		etherTran.bindSubscription(emptySlot); // live now if the stream is already arriving
 		return emptySlot;
-		// other particulars (e.g IP) will be filled in later
 	}
 	else
 		return EOQ;
 }
 
 // subscribe by name/IP
-int AudioInputNet::subscribe(char * streamName, IPAddress remoteIP)
+int AudioInputNetBase::subscribe(char * streamName, IPAddress remoteIP)
 {
-	if(_myStreamI != EOQ) // already subscribed
-			return _myStreamI;
+	if(_mySubI != EOQ) // already subscribed
+			return _mySubI;
 	int i;
 	int emptySlot = EOQ;
 	for (i = 0; i < MAX_SUBSCRIPTIONS; i++)
@@ -245,34 +405,38 @@ int AudioInputNet::subscribe(char * streamName, IPAddress remoteIP)
 	}
 	if(emptySlot != EOQ) // there's space
 	 {
+		 if(!etherTran.setSubAddress(emptySlot, remoteIP)) // a multicast group is joined
+			 return EOQ;
 		 etherTran.subsIn[emptySlot].qPtr = &_myQueueI;
 		 etherTran.subsIn[emptySlot].active = true;
-		 etherTran.subsIn[emptySlot].protocol = OK_VBAN_AUDIO_PROTO;
+		 etherTran.subsIn[emptySlot].protocol = VBAN_AUDIO_SHIFTED;
 		 strncpy(etherTran.subsIn[emptySlot].streamName, streamName, VBAN_STREAM_NAME_LENGTH-1);
-		 strcpy(etherTran.subsIn[emptySlot].streamName, "?");
-		 etherTran.subsIn[emptySlot].ipAddress = remoteIP;
+		 strcpy(etherTran.subsIn[emptySlot].hostName, "?");
 #ifdef IN_DEBUG
 		 Serial.printf("--Subscribed Audio In to '%s', slot %i, IP ", streamName, emptySlot);
 		 Serial.println(remoteIP);
 #endif
 		_mySubI = emptySlot;
+		 etherTran.setReorderWindow(emptySlot, _reorderFrames);
+		 etherTran.subsIn[emptySlot].compressed = _compressed;
+		 etherTran.bindSubscription(emptySlot);
 		 return emptySlot;
 	 }
 	return EOQ;
 }
 
 
-void AudioInputNet::unSubscribe(void)  // release the subscribed stream. 
+// release the subscribed stream. 
+// Packets already queued are released by update()
+void AudioInputNetBase::unSubscribe(void)
 {
-	if (_myStreamI >= 0)
-	{
-		etherTran.streamsIn[_myStreamI].subscription = EOQ;
-		etherTran.subsIn[_myStreamI].active = false;
-	}
+	if (_mySubI != EOQ)
+		etherTran.unbindSubscription(_mySubI);
+	_mySubI = EOQ;
 	_myStreamI = EOQ; 	
 }
 
-int AudioInputNet::droppedFrames(bool reset)
+int AudioInputNetBase::droppedFrames(bool reset)
 {
 	int temp;
 	temp = framesDropped;
@@ -281,12 +445,12 @@ int AudioInputNet::droppedFrames(bool reset)
 	return temp;
 }
 
-int AudioInputNet::getPktsInQueue()
+int AudioInputNetBase::getPktsInQueue()
 {
 	return _myQueueI.size();
 }
 	
-int AudioInputNet::missedTransmit(bool reset)
+int AudioInputNetBase::missedTransmit(bool reset)
 {
 	int temp;
 	temp = didNotTransmit;
@@ -299,7 +463,7 @@ int AudioInputNet::missedTransmit(bool reset)
 	
 // debug print packet contents
 
-void AudioInputNet::print6pkt(queuePkt * pkt, int first, int last)
+void AudioInputNetBase::print6pkt(queuePkt * pkt, int first, int last)
 {
 #ifdef IN_DEBUG
 	int i;
@@ -314,7 +478,7 @@ void AudioInputNet::print6pkt(queuePkt * pkt, int first, int last)
 }
 
 // debug print buffer contents
-void AudioInputNet::print3buf(int indx, int first, int last)
+void AudioInputNetBase::print3buf(int indx, int first, int last)
 {
 #ifdef IN_DEBUG
 	int i;
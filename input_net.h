@@ -13,6 +13,13 @@
 #include "Audio.h"
 #include "audio_net.h"
 #include "control_ethernet.h"
+#include "jitter_net.h"
+#include "conceal_net.h"
+#include "resample_net.h"
+#include "format_net.h"
+#include "interleave_net.h"
+#include "codec_net.h"
+#include "group_net.h"
 
 //#define IN_DEBUG
 
@@ -30,34 +37,64 @@
 
 extern  AudioControlEtherTransport etherTran; // handles all stream and subscription traffic
 
-class AudioInputNet : public AudioStream 
+// All of the input's work. Buffers are owned by AudioInputNetT<N> (exact size) or AudioInputNet (MAXCHANNELS)
+class AudioInputNetBase : public AudioStream 
 {
 public:
-	AudioInputNet(int inCh = DEFAULT_CHANNELS) : AudioStream(0, NULL) 
-	{ 
-		_inChans = inCh;
-	}
-		
 	friend class AudioControlEthernet; // may not be required
 	friend class AudioControlEtherTransport;
+	friend class StreamGroup;
 
 	void begin(void);
 	void update(void);
 
 	int subscribe(char * name, char * hostName = nullptr); // use this for broadcast
-	int subscribe(char * name, IPAddress remoteIP);
+	int subscribe(char * name, IPAddress remoteIP); // a multicast remoteIP joins that group (any sender)
 	void unSubscribe(void); // release the subscribed stream. Packets will not be queued.
 	
 	int droppedFrames(bool reset = true);	// get and reset the number of dropped frames
 	int missedTransmit(bool reset = true); // failed to transmit - perhaps out of AudioMemory
+
+	// jitter buffer
+	void setJitterProfile(jbProfile profile);	// JB_LOW_LATENCY or JB_ROBUST
+	void setJitterTarget(int minSamples, int maxSamples = 0); // override the profile's smallest (and largest) target depth
+	uint32_t latencyUs(void);				// network buffering at the last update()
+	int bufferedSamples(void) { return _buffered; }
+	int targetSamples(void) { return _jb.target(); }
+	uint32_t underruns(void) { return _jb.underruns; }
+	float driftPpm(void) { return _jb.driftPpm(); }	// sender's clock against ours, as followed by the rate converter
+	int delaySamples(void) { return _delay; }	// StreamGroup members: playout delay at the last update()
+
+	// packet loss concealment
+	void setConcealment(plcMode mode);	// PLC_SILENCE, PLC_REPEAT or PLC_PITCH (default)
+	uint32_t concealedSamples(void) { return _plc.concealedSamples; }
+
+	// INT24, INT32 and FLOAT32 streams
+	void setDither(bool dither) { _dither = dither; }	// TPDF dither down to 16 bits (default off: truncate)
+
+	// compressed frames from another Teensy (codec_net.h). Off by default, so only PCM is queued
+	bool setCompressed(bool accept);	// false: no memory for the decoder
+
+	// out of order packets
+	void setReorderWindow(int frames);	// how late (frames) a packet may be and still be played in order. 0 .. REORDER_MAX
+	uint32_t reorderedFrames(void);			// late packets put back in order
 protected:	
+	AudioInputNetBase(int inCh, audio_block_t **blocks, int16_t *plcHist, int16_t *rsBuf) : AudioStream(0, NULL),
+		_inChans(inCh), new_block(blocks), _plc(plcHist, inCh), _rs(rsBuf, inCh) {}
+
+	// INT16 packets: de-interleave channels into dst[0 .. _inChans-1]
+	virtual void unpack16(const int16_t *src, int channels, int16_t * const *dst, int n)
+	{
+		deinterleave16(src, channels, dst, _inChans, n);
+	}
+
 	//unsigned long getCurPktNo(void) { return _currentPkt_I;} // user side 
 	int getPktsInQueue();
 	int itim; //debug
 
 	int getMyStream(void) { return _myStreamI; } // get the ID of my subscribed stream
 
-	std::queue <queuePkt> _myQueueI;
+	pktHandleQueue _myQueueI;	// pointers into etherTran.rxPool
 	bool update_responsibility = false;
 
 private:
@@ -66,16 +103,35 @@ private:
 	int _mySubI = -1;  		// subscription index
 
 	// internal buffers and pointers
-	audio_block_t * new_block[MAXCHANNELS];
+	audio_block_t ** new_block;	// [_inChans]
 	
 	// internal status and control 
 	bool inputBegun = false;
 
 
-//	int _queueLowWater = QUEUE_LOW_WATER; // net quality & delay. Increase if poor qual
- 
-	int _currentBuffer = 0; // may take several calls to fill the packet
-	int qUsedSamples = 0;		// 
+	JitterBuffer _jb;
+	int _buffered = 0;			// samples queued at the last update() (at our rate)
+	int qUsedSamples = 0;		// samples already taken from the packet at the front of the queue
+	int readFrames(int16_t * const *dst, int offset, int n, bool copy = true);
+	Concealer _plc;
+	Resampler _rs;
+	int _gapSamples = 0;		// still to be concealed for lost packets
+	bool _frameValid = false;	// _lastQFrameNum is set
+	int _reorderFrames = REORDER_WINDOW;
+	const vbanFormat *format(uint8_t format_bit);
+	void decodeFrame(const queuePkt *pkt);
+	const vbanFormat *_fmt = nullptr;
+	uint8_t _fmtBit = 0;
+	bool _dither = false;
+	uint32_t _ditherState = 0x2545F491;
+	StreamGroup *_group = nullptr;		// see group_net.h
+	int _groupSlot = 0;
+	uint32_t _groupEpoch = 0;				// the group's last resync seen
+	int _delay = 0;
+	int groupLead(const streamInfo &st, float toLocal, int pktSamples, int jitter);
+	bool _compressed = false;
+	int16_t *_codecBuf = nullptr;				// a decoded frame: [_inChans][NET_FRAME_MAX]. Allocated by setCompressed()
+	const queuePkt *_decoded = nullptr;	// the frame in _codecBuf
 	 
 	//debug
 	int npiq; //there were no packets to process in the queue
@@ -87,4 +143,39 @@ private:
 	void print3buf(int indx, int first, int last);
 };
 
+// N channels, fixed at compile time: buffers are sized for N and INT16 streams of N channels use the unrolled kernel
+template <int N> class AudioInputNetT : public AudioInputNetBase
+{
+	static_assert(N >= 1 && N <= MAXCHANNELS, "AudioInputNetT: 1 to MAXCHANNELS channels");
+public:
+	AudioInputNetT() : AudioInputNetBase(N, _blocks, _plcHist[0], _rsBuf[0]) {}
+	static constexpr int channels = N;
+
+protected:
+	void unpack16(const int16_t *src, int srcChannels, int16_t * const *dst, int n) override
+	{
+		if(srcChannels == N)
+			deinterleave16T<N>(src, dst, n);
+		else
+			deinterleave16(src, srcChannels, dst, N, n);
+	}
+
+private:
+	audio_block_t *_blocks[N];
+	int16_t _plcHist[N][PLC_HISTORY];
+	int16_t _rsBuf[N][RESAMPLE_BUF];
+};
+
+// channels chosen at run time, up to MAXCHANNELS
+class AudioInputNet : public AudioInputNetBase
+{
+public:
+	AudioInputNet(int inCh = DEFAULT_CHANNELS) : AudioInputNetBase((inCh > MAXCHANNELS) ? MAXCHANNELS : inCh, _blocks, _plcHist[0], _rsBuf[0]) {}
+
+private:
+	audio_block_t *_blocks[MAXCHANNELS];
+	int16_t _plcHist[MAXCHANNELS][PLC_HISTORY];
+	int16_t _rsBuf[MAXCHANNELS][RESAMPLE_BUF];
+};
+
 
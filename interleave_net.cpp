@@ -0,0 +1,159 @@
+/* 16 bit interleave / de-interleave kernels for the network audio objects
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <string.h>
+#include "interleave_net.h"
+#if defined(TEENSYDUINO)
+	#include "utility/dspinst.h"	// pack_16b_16b(), pack_16t_16t(): PKHBT, PKHTB
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+const int16_t interleaveSilence[INTERLEAVE_MAX_SAMPLES] = {0};
+
+// packet and block offsets may be odd: words go through memcpy, which compiles to single (unaligned) loads and stores
+static inline uint32_t ld32(const int16_t *p) { uint32_t w; memcpy(&w, p, 4); return w; }
+static inline void st32(int16_t *p, uint32_t w) { memcpy(p, &w, 4); }
+
+/******** stereo ********/
+void deinterleave16x2(const int16_t *src, int16_t * const *dst, int n)
+{
+	int16_t *l = dst[0], *r = dst[1];
+	int j = 0;
+#if defined(TEENSYDUINO)
+	for(; j + 2 <= n; j += 2)
+	{
+		uint32_t f0 = ld32(src + 2 * j);			// L0 | R0 << 16
+		uint32_t f1 = ld32(src + 2 * j + 2);
+		st32(l + j, pack_16b_16b(f1, f0));	// L0 | L1 << 16
+		st32(r + j, pack_16t_16t(f1, f0));	// R0 | R1 << 16
+	}
+#elif defined(__SSE2__)
+	for(; j + 8 <= n; j += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * j));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * j + 8));
+		__m128i la = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16), lb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		__m128i ra = _mm_srai_epi32(a, 16), rb = _mm_srai_epi32(b, 16);
+		_mm_storeu_si128((__m128i *)(l + j), _mm_packs_epi32(la, lb));
+		_mm_storeu_si128((__m128i *)(r + j), _mm_packs_epi32(ra, rb));
+	}
+#elif defined(__ARM_NEON)
+	for(; j + 8 <= n; j += 8)
+	{
+		int16x8x2_t v = vld2q_s16(src + 2 * j);
+		vst1q_s16(l + j, v.val[0]);
+		vst1q_s16(r + j, v.val[1]);
+	}
+#endif
+	for(; j < n; j++)
+	{
+		l[j] = src[2 * j];
+		r[j] = src[2 * j + 1];
+	}
+}
+
+void interleave16x2(const int16_t *l, const int16_t *r, int16_t *dst, int n)
+{
+	int j = 0;
+#if defined(TEENSYDUINO)
+	for(; j + 2 <= n; j += 2)
+	{
+		uint32_t lp = ld32(l + j), rp = ld32(r + j);
+		st32(dst + 2 * j, pack_16b_16b(rp, lp));			// L0 | R0 << 16
+		st32(dst + 2 * j + 2, pack_16t_16t(rp, lp));	// L1 | R1 << 16
+	}
+#elif defined(__SSE2__)
+	for(; j + 8 <= n; j += 8)
+	{
+		__m128i lv = _mm_loadu_si128((const __m128i *)(l + j));
+		__m128i rv = _mm_loadu_si128((const __m128i *)(r + j));
+		_mm_storeu_si128((__m128i *)(dst + 2 * j), _mm_unpacklo_epi16(lv, rv));
+		_mm_storeu_si128((__m128i *)(dst + 2 * j + 8), _mm_unpackhi_epi16(lv, rv));
+	}
+#elif defined(__ARM_NEON)
+	for(; j + 8 <= n; j += 8)
+	{
+		int16x8x2_t v = {{vld1q_s16(l + j), vld1q_s16(r + j)}};
+		vst2q_s16(dst + 2 * j, v);
+	}
+#endif
+	for(; j < n; j++)
+	{
+		dst[2 * j] = l[j];
+		dst[2 * j + 1] = r[j];
+	}
+}
+
+/******** dispatch ********/
+void deinterleave16(const int16_t *src, int srcChannels, int16_t * const *dst, int dstChannels, int n)
+{
+	if(dstChannels == srcChannels)
+		switch(srcChannels)
+		{
+			case 1 :
+				deinterleave16T<1>(src, dst, n);
+				return;
+			case 2 :
+				deinterleave16T<2>(src, dst, n);
+				return;
+			case 4 :
+				deinterleave16T<4>(src, dst, n);
+				return;
+			case 6 :
+				deinterleave16T<6>(src, dst, n);
+				return;
+			case 8 :
+				deinterleave16T<8>(src, dst, n);
+				return;
+		}
+	if(dstChannels > srcChannels)
+		dstChannels = srcChannels;
+	for(int i = 0; i < dstChannels; i++) // a channel at a time
+	{
+		int16_t *d = dst[i];
+		const int16_t *s = src + i;
+		for(int j = 0; j < n; j++)
+			d[j] = s[j * srcChannels];
+	}
+}
+
+void interleave16(const int16_t * const *src, int channels, int16_t *dst, int n)
+{
+	switch(channels)
+	{
+		case 1 :
+			interleave16T<1>(src, dst, n);
+			return;
+		case 2 :
+			interleave16T<2>(src, dst, n);
+			return;
+		case 4 :
+			interleave16T<4>(src, dst, n);
+			return;
+		case 6 :
+			interleave16T<6>(src, dst, n);
+			return;
+		case 8 :
+			interleave16T<8>(src, dst, n);
+			return;
+	}
+	const int16_t *s[MAXCHANNELS];
+	if(channels > MAXCHANNELS)
+		channels = MAXCHANNELS;
+	for(int i = 0; i < channels; i++)
+		s[i] = (src[i] == nullptr) ? interleaveSilence : src[i];
+	for(int i = 0; i < channels; i++)
+	{
+		const int16_t *c = s[i];
+		int16_t *d = dst + i;
+		for(int j = 0; j < n; j++)
+			d[j * channels] = c[j];
+	}
+}
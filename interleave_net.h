@@ -0,0 +1,71 @@
+/* 16 bit interleave / de-interleave kernels for the network audio objects
+ *
+ * VBAN packets carry channels interleaved (frame by frame); the audio library carries one block per channel.
+ * Kernels are specialised for 1, 2, 4, 6 and 8 channels, with a generic loop for the rest:
+ *	Teensy: 2 channels move two frames per step with the DSP pack instructions (utility/dspinst.h)
+ *	x86 (SSE2) and ARM hosts (NEON): 2 channels move eight frames per step
+ *	4, 6 and 8 channels: fixed stride loops the compiler unrolls
+ * interleave16() substitutes silence for nullptr (unconnected) channels, so the kernels never test per sample.
+ * deinterleave16T<C>() and interleave16T<C>() are the same kernels for a channel count known at compile time
+ * (AudioInputNetT, AudioOutputNetT), without the dispatch.
+ * See examples/InterleaveBenchmark for timings against the plain loops.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _INTERLEAVE_NET_H_
+#define _INTERLEAVE_NET_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "audio_net.h"
+
+#define INTERLEAVE_MAX_SAMPLES	256		// per call: a VBAN frame
+
+// n frames of src (srcChannels interleaved) to dst[0 .. dstChannels-1]. Extra source channels are skipped
+void deinterleave16(const int16_t *src, int srcChannels, int16_t * const *dst, int dstChannels, int n);
+
+// n samples from each src[ch] (nullptr: silence) to interleaved dst. n <= INTERLEAVE_MAX_SAMPLES, channels <= MAXCHANNELS
+void interleave16(const int16_t * const *src, int channels, int16_t *dst, int n);
+
+// stereo kernels, and silence for unconnected channels
+void deinterleave16x2(const int16_t *src, int16_t * const *dst, int n);
+void interleave16x2(const int16_t *l, const int16_t *r, int16_t *dst, int n);
+extern const int16_t interleaveSilence[INTERLEAVE_MAX_SAMPLES];
+
+// C channels in and out
+template <int C> inline void deinterleave16T(const int16_t *src, int16_t * const *dst, int n)
+{
+	if(C == 1)
+		memcpy(dst[0], src, n * sizeof(int16_t));
+	else if(C == 2)
+		deinterleave16x2(src, dst, n);
+	else
+	{
+		int16_t *d[C];
+		for(int i = 0; i < C; i++)
+			d[i] = dst[i];
+		for(int j = 0; j < n; j++, src += C)
+			for(int i = 0; i < C; i++)
+				d[i][j] = src[i];
+	}
+}
+
+template <int C> inline void interleave16T(const int16_t * const *src, int16_t *dst, int n)
+{
+	const int16_t *s[C];
+	for(int i = 0; i < C; i++)
+		s[i] = (src[i] == nullptr) ? interleaveSilence : src[i];
+	if(C == 1)
+		memcpy(dst, s[0], n * sizeof(int16_t));
+	else if(C == 2)
+		interleave16x2(s[0], s[C - 1], dst, n);
+	else
+		for(int j = 0; j < n; j++, dst += C)
+			for(int i = 0; i < C; i++)
+				dst[i] = s[i][j];
+}
+
+#endif
@@ -0,0 +1,80 @@
+/* Adaptive jitter buffer control for AudioInputNet
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include "jitter_net.h"
+
+void JitterBuffer::setProfile(jbProfile profile)
+{
+	switch(profile)
+	{
+		case JB_ROBUST :
+			_jitterMult = 4;
+			_minTarget = AUDIO_BLOCK_SAMPLES * 3;
+			break;
+		case JB_LOW_LATENCY :
+		default :
+			_jitterMult = 2;
+			_minTarget = AUDIO_BLOCK_SAMPLES;
+			break;
+	}
+	_target = _goal = _minTarget;
+}
+
+void JitterBuffer::setTarget(int minSamples, int maxSamples)
+{
+	if(minSamples > 0)
+		_minTarget = minSamples;
+	_maxTarget = maxSamples;
+	_target = _goal = _minTarget;
+}
+
+int JitterBuffer::plan(int buffered, int jitterSamples, int pktSamples, int capacity, int lead)
+{
+	// move the target: up by a quarter of the difference, down by one sample per block
+	int top = (_maxTarget > 0 && _maxTarget < capacity) ? _maxTarget : capacity;
+	int want = _jitterMult * jitterSamples + AUDIO_BLOCK_SAMPLES + pktSamples / 2;
+	if(want < _minTarget)
+		want = _minTarget;
+	if(want > top)
+		want = top;
+	if(want > _target)
+		_target += (want - _target + 3) / 4;
+	else if(want < _target)
+		_target--;
+	_goal = _target;
+	if(_hold > 0)
+		_goal = (_hold < top + pktSamples) ? _hold : top + pktSamples;	// a queue full, plus the packet arriving
+
+	int depth = buffered + lead;
+	if(_preroll)
+	{
+		if(depth < _goal || buffered < AUDIO_BLOCK_SAMPLES)
+			return 0;
+		_preroll = false;
+		_avgDepth = depth * 16;
+	}
+	if(buffered < AUDIO_BLOCK_SAMPLES) // ran dry: fill back up to the target before playing again
+	{
+		underruns++;
+		_preroll = true;
+		return 0;
+	}
+	// depth is judged on its average (about 93mS: 32 blocks of 128) so that jitter itself doesn't move the rate
+	_avgDepth += (depth * 16 - _avgDepth) / (32 * 128 / AUDIO_BLOCK_SAMPLES);
+	float err = (float)_avgDepth / 16 - _goal;
+	_drift += JB_KI * err;
+	if(_drift > JB_MAX_PPM)
+		_drift = JB_MAX_PPM;
+	if(_drift < -JB_MAX_PPM)
+		_drift = -JB_MAX_PPM;
+	_ppm = JB_KP * err + _drift;
+	if(_ppm > JB_MAX_PPM)
+		_ppm = JB_MAX_PPM;
+	if(_ppm < -JB_MAX_PPM)
+		_ppm = -JB_MAX_PPM;
+	return AUDIO_BLOCK_SAMPLES;
+}
@@ -0,0 +1,68 @@
+/* Adaptive jitter buffer control for AudioInputNet
+ *
+ * The buffer itself is the input's packet queue. JitterBuffer decides, once per audio update(), how many samples to take from it:
+ *	- the target depth (samples) follows the measured inter-arrival jitter: it grows quickly and shrinks slowly.
+ *	  Half a packet is added, as depth saw-tooths by a packet around its average
+ *	- pre-roll: after start or an underrun nothing is played until the target depth is reached
+ *	- average depth is held at the target by running the input's rate converter slightly fast or slow (a PI controller).
+ *	  The integral term is the estimated drift between the sender's clock and ours.
+ * Profiles set how many times the jitter estimate is kept in hand, and the smallest target.
+ * In a StreamGroup (group_net.h) the group holds the target, and depth is the playout delay rather than the samples queued.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _JITTER_NET_H_
+#define _JITTER_NET_H_
+
+#include <stdint.h>
+#include "audio_net.h"
+
+enum jbProfile {JB_LOW_LATENCY, JB_ROBUST};
+#define JB_DEFAULT_PROFILE	JB_LOW_LATENCY
+
+#define JB_KP				2.0f			// ppm per sample of depth error
+#define JB_KI				(0.00025f * AUDIO_BLOCK_SAMPLES / 128)	// ppm per sample of depth error, per block: the same time constant for any block size
+#define JB_MAX_PPM	2000.0f		// largest rate correction (about 3.5 cents)
+
+class JitterBuffer
+{
+public:
+	JitterBuffer() { setProfile(JB_DEFAULT_PROFILE); }
+
+	void setProfile(jbProfile profile);
+	void setTarget(int minSamples, int maxSamples = 0); // limits for the target (0: profile default, or queue capacity)
+
+	// once per update(): samples waiting, jitter estimate, samples per packet and the most the queue can hold (samples)
+	// lead: added to buffered for the depth the target applies to (StreamGroup: the rest of the playout delay)
+	// returns 0 (pre-roll: conceal this block) or AUDIO_BLOCK_SAMPLES (play, at the rate given by correctionPpm())
+	int plan(int buffered, int jitterSamples, int pktSamples, int capacity, int lead = 0);
+	void reset(void) { _preroll = true; }
+	void resetDrift(void) { _drift = _ppm = 0; }		// new stream
+	void hold(int samples) { _hold = samples; }			// a target set from outside (StreamGroup). 0: our own
+	void rebase(int depth) { _avgDepth = depth * 16; }	// depth has been moved (samples skipped)
+
+	int target(void) { return _goal; }
+	int ownTarget(void) { return _target; }	// what the jitter alone calls for
+	int avgDepth(void) { return _avgDepth / 16; }
+	bool prerolling(void) { return _preroll; }
+	float correctionPpm(void) { return _ppm; }	// run the input this much fast (+) or slow (-)
+	float driftPpm(void) { return _drift; }
+	uint32_t underruns = 0;
+
+private:
+	int _jitterMult;		// target = _jitterMult * jitter + one block + half a packet
+	int _minTarget;
+	int _maxTarget = 0;	// 0: queue capacity
+	int _target;
+	int _hold = 0;
+	int _goal;					// target in use: _target, or _hold
+	int _avgDepth = 0;	// samples * 16
+	float _drift = 0;		// integral term (ppm)
+	float _ppm = 0;
+	bool _preroll = true;
+};
+
+#endif
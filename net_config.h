@@ -0,0 +1,72 @@
+/* Compile time sizing for the Teensy Ethernet Audio Library
+ *
+ * All capacities come from one configuration traits struct, NetConfig.
+ * Select a preset (or your own struct derived from NetConfigDefault) with a build flag, e.g.
+ *		-DNET_CONFIG=NetConfigSensor
+ * The usual MAX_xxx macros in audio_net.h are aliases for NetConfig members.
+ * netRamFootprint<NetConfig>() (audio_net.h) is checked against NetConfig::ramBudget at compile time.
+ * Queue depths are in samples: packet counts follow AUDIO_BLOCK_SAMPLES, so smaller blocks need more packet buffers
+ * for the same depth. NetConfigLowLatency suits 32 sample blocks.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _NET_CONFIG_H_
+#define _NET_CONFIG_H_
+
+#include <stdint.h>
+
+struct NetConfigDefault
+{
+	static constexpr int streams = 8;					// in or out
+	static constexpr int hosts = 32;					// hostname to IP matches
+	static constexpr int subscriptions = 8;		// may differ from streams
+	static constexpr int audioQueueSamples = 12 * 128;	// high water mark in an audio queue (samples per channel, 35mS)
+	static constexpr int maxChannels = 8;			// per input or output object
+	static constexpr int serviceQueue = 32;
+	static constexpr uint32_t outQueueBytes = 8 * 1024;	// packet slab per output object. A full queue of stereo packets (raise for more channels)
+	static constexpr uint32_t ramBudget = 400 * 1024;	// bytes of RAM1 + RAM2 the transport and its queues may use
+};
+
+// one or two small streams, e.g. a microphone or sensor node
+struct NetConfigSensor : NetConfigDefault
+{
+	static constexpr int streams = 2;
+	static constexpr int hosts = 4;
+	static constexpr int subscriptions = 2;
+	static constexpr int audioQueueSamples = 6 * 128;
+	static constexpr int maxChannels = 2;
+	static constexpr int serviceQueue = 8;
+	static constexpr uint32_t outQueueBytes = 4 * 1024;
+	static constexpr uint32_t ramBudget = 64 * 1024;
+};
+
+// many streams, shallower queues, up to 4 channels each
+struct NetConfigMixer : NetConfigDefault
+{
+	static constexpr int streams = 32;
+	static constexpr int subscriptions = 32;
+	static constexpr int audioQueueSamples = 6 * 128;
+	static constexpr int maxChannels = 4;
+	static constexpr uint32_t ramBudget = 640 * 1024;
+};
+
+// monitoring paths built with short blocks (e.g. -DAUDIO_BLOCK_SAMPLES=32): shallow queues of small packets
+struct NetConfigLowLatency : NetConfigDefault
+{
+	static constexpr int audioQueueSamples = 12 * 32;	// 8.7mS
+};
+
+#ifndef NET_CONFIG
+	#define NET_CONFIG NetConfigDefault
+#endif
+typedef NET_CONFIG NetConfig;
+
+// derived sizes, for any configuration. AUDIO_BLOCK_SAMPLES is set by audio_net.h
+template <typename C> constexpr int audioQueuePkts(void) { return (C::audioQueueSamples + AUDIO_BLOCK_SAMPLES - 1) / AUDIO_BLOCK_SAMPLES; }	// queue depth in blocks
+template <typename C> constexpr int pktQueueLen(void) { return audioQueuePkts<C>() + 2; }	// output objects may push two packets past the high water mark
+template <typename C> constexpr int pktPoolSize(void) { return C::subscriptions * audioQueuePkts<C>() / 2; }	// receive buffers shared by all input queues
+
+#endif
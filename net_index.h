@@ -0,0 +1,64 @@
+/* Lookup keys and hashing for the stream and host registries (AudioControlEtherTransport)
+ *
+ * Stream names are compared as four 32-bit words rather than with strcmp().
+ * Registries use small open-addressed hash tables of slot indices, sized to a power of two at least twice the number of slots.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _NET_INDEX_H_
+#define _NET_INDEX_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "IPAddress.h"
+#include "audio_vban.h"
+
+#define NAME_WORDS (VBAN_STREAM_NAME_LENGTH / 4)
+
+// power of two, at least twice n (load factor <= 0.5 keeps probe sequences short)
+constexpr int hashTableSize(int n, int size = 2)
+{
+	return (size >= 2 * n) ? size : hashTableSize(n, size * 2);
+}
+
+inline uint32_t hashMix(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x7feb352d;
+	h ^= h >> 15;
+	h *= 0x846ca68b;
+	h ^= h >> 16;
+	return h;
+}
+
+inline uint32_t ipHash(IPAddress ip)
+{
+	return hashMix((uint32_t)ip);
+}
+
+// (remote IP, stream name) with the name zero padded to 16 bytes, so equality is a 5 word compare
+struct streamKey
+{
+	uint32_t ip = 0;
+	uint32_t name[NAME_WORDS] = {0};
+	uint32_t hash = 0;
+
+	void set(IPAddress remoteIP, const char *sName)
+	{
+		ip = (uint32_t)remoteIP;
+		strncpy((char *)name, sName, VBAN_STREAM_NAME_LENGTH); // pads with zeros after the terminator
+		uint32_t h = ip;
+		for(int i = 0; i < NAME_WORDS; i++)
+			h = hashMix(h ^ name[i]);
+		hash = h;
+	}
+	bool operator==(const streamKey &k) const
+	{
+		return ip == k.ip && name[0] == k.name[0] && name[1] == k.name[1] && name[2] == k.name[2] && name[3] == k.name[3];
+	}
+};
+
+#endif
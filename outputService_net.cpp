@@ -86,9 +86,8 @@ bool AudioOutputServiceNet::send(uint8_t *data, int length, char* streamName, ui
 	//Serial.printf("pkt-dat offset %i [%i], pkt-hdr offset %i\n", dat - (uint8_t *)&pkt, (uint8_t *)&pkt.c.content[0] - (uint8_t *)&pkt,(uint8_t *)&pkt.hdr - (uint8_t *)&pkt);
 	memcpy((void*)dat, (void*)data, length); //&(pkt.c.content[0]
 
-	cli(); 
-		_myQueueO.push(pkt); // not during update() processing
-	sei();
+	if(!_myQueueO.push(pkt, QPKT_HDR_SIZE + length))
+		return false;
 		//_nextFrame++;
 #ifdef OS_DEBUG
 	if(printMe) Serial.printf("Pushed packet, Qlen %i, ", _myQueueO.size());
@@ -32,13 +32,14 @@ public:
 	
 	void begin(void);
 	bool send(uint8_t *data, int length, char *streamName, uint8_t sType, IPAddress remoteIP = IPAddress((uint32_t)(0))); // bool extend?
-	int subscribe(char *sName, uint8_t sType, IPAddress remoteIP = IPAddress((uint32_t)0)); // default to broadcast IP
+	int subscribe(char *sName, uint8_t sType, IPAddress remoteIP = IPAddress((uint32_t)0)); // default to broadcast IP. May be a multicast group (etherTran.getGroupIP())
 
 
 	int missedTransmit(bool reset = true);	// get (and reset) the number of missed transmit buffer on update
+	uint32_t queueBytes(void) { return _myQueueO.bytesUsed(); }	// queue memory in use
 
 protected:
-	std::queue <queuePkt> _myQueueO;
+	pktQueue _myQueueO;
 	int _myStreamO = EOQ; // valid streamID is 0..255
 
 private:
@@ -17,14 +17,14 @@
 #include "output_net.h"
 
 
-void AudioOutputNet::begin(void)
+void AudioOutputNetBase::begin(void)
 {
 	if(outputBegun)
 		return;
 	_nextFrame = 0; // initialize packet sequence
 	didNotTransmit = 0;
 	// make sure local audio block pointers aren't pointing
-	for (int i = 0; i < MAXCHANNELS; i++)
+	for (int i = 0; i < _outChans; i++)
 	{		
 		block[i] = NULL;
 
@@ -41,7 +41,7 @@ void AudioOutputNet::begin(void)
 /******************** update **************************/
 // place any avaiable incoming AudioStream buffers into the queue
 // we won't transmit zero packets if there are none provided by AudioStream
-void AudioOutputNet::update(void)
+void AudioOutputNetBase::update(void)
 {
 #ifdef ON_DEBUG
 	static int otim = 0;
@@ -83,65 +83,206 @@ void AudioOutputNet::update(void)
 		//if(printMe) Serial.printf("O: Released, Audiomem %i\n", AudioMemoryUsage());
 }
 
-// queue output blocks
-// split streams with more than CHANS_2_PKTS into two equal packets
-bool AudioOutputNet::queueBlocks(void)
+// queue output blocks, converted to the stream's rate if required
+// split into as many equal packets as VBAN_MAX_DATA needs (e.g. two for 6 or more channels)
+bool AudioOutputNetBase::queueBlocks(void)
 {
 	if(_myStreamO == EOQ) // just to be safe
 		return false;
 	if(_myQueueO.size() > MAX_AUDIO_QUEUE)
 	{
+		didNotTransmit++;
 #ifdef ON_DEBUG
 		if(printMe) Serial.printf("Dropped outgoing audio block");
 #endif
 		return false;
 	}
-	
-	queuePkt pkt;
+
+	const int16_t *src[MAXCHANNELS];	// nullptr: silence
+	int samples = AUDIO_BLOCK_SAMPLES;
+	if(_conv != nullptr)
+	{
+		int16_t *in[MAXCHANNELS];
+		_conv->rs.input(in, _outChans);
+		for(int i = 0; i < _outChans; i++)
+		{
+			if(block[i] == nullptr)
+				memset(in[i], 0, AUDIO_BLOCK_SAMPLES * sizeof(int16_t));
+			else
+				memcpy(in[i], block[i]->data, AUDIO_BLOCK_SAMPLES * sizeof(int16_t));
+		}
+		_conv->rs.commit(AUDIO_BLOCK_SAMPLES);
+		samples = _conv->rs.outputAvailable();
+		if(samples > OUT_CONV_SAMPLES)
+			samples = OUT_CONV_SAMPLES;
+		int16_t *out[MAXCHANNELS];
+		for(int i = 0; i < _outChans; i++)
+		{
+			out[i] = _conv->buf + _outChans * RESAMPLE_BUF + i * OUT_CONV_SAMPLES;
+			src[i] = out[i];
+		}
+		_conv->rs.process(out, _outChans, samples);
+	}
+	else
+		for(int i = 0; i < _outChans; i++)
+			src[i] = (block[i] == nullptr) ? nullptr : block[i]->data;
+
+	if(_stage != nullptr) // gather into frames of _frameSamples
+	{
+		int done = 0;
+		while(done < samples)
+		{
+			int count = _frameSamples - _stageSamples;
+			if(count > samples - done)
+				count = samples - done;
+			for(int i = 0; i < _outChans; i++)
+			{
+				int16_t *to = _stage + i * NET_FRAME_MAX + _stageSamples;
+				if(src[i] == nullptr)
+					memset(to, 0, count * sizeof(int16_t));
+				else
+					memcpy(to, src[i] + done, count * sizeof(int16_t));
+			}
+			_stageSamples += count;
+			done += count;
+			if(_stageSamples >= _frameSamples)
+			{
+				const int16_t *from[MAXCHANNELS];
+				for(int i = 0; i < _outChans; i++)
+					from[i] = _stage + i * NET_FRAME_MAX;
+				sendFrame(from, _stageSamples);
+				_stageSamples = 0;
+			}
+		}
+		return true;
+	}
+
+	int pkts = (samples + _pktSamples - 1) / _pktSamples;
 	int samplesProc = 0;
-	// pack blocks into one or two VBAN packets
-	int samplesPkt = SAMPLES_BUF;
-	if(_outChans > CHANS_2_PKTS)
-		samplesPkt = SAMPLES_BUF/2;
-	
+	for(int p = 0; p < pkts; p++)
+	{
+		int samplesPkt = (samples - samplesProc) / (pkts - p);
+		const int16_t *from[MAXCHANNELS];
+		for(int i = 0; i < _outChans; i++)
+			from[i] = (src[i] == nullptr) ? nullptr : src[i] + samplesProc;
+		sendFrame(from, samplesPkt);
+		samplesProc += samplesPkt;
+	}
+	return true;
+}
+
+// build a frame from samples of each src[ch] (nullptr: silence) and queue it for transmit
+void AudioOutputNetBase::sendFrame(const int16_t * const *src, int samples)
+{
+	queuePkt pkt;
 	// hdr VBAN flag is set
-	pkt.hdr.format_SR = OK_VBAN_AUDIO_PROTO;
-	pkt.hdr.format_nbs = samplesPkt - 1;
+	pkt.hdr.format_SR = _formatSR;
 	pkt.hdr.format_nbc = _outChans - 1;
-	pkt.hdr.format_bit = OK_VBAN_FMT;	
+	pkt.hdr.format_nbs = samples - 1;
 	strncpy(pkt.hdr.streamname, 	etherTran.streamsOut[_myStreamO].hdr.streamname, VBAN_STREAM_NAME_LENGTH-1);
-
+	int bytes;
+	if(_codec == NET_CODEC_PCM)
+	{
+		pkt.hdr.format_bit = OK_VBAN_FMT;	
+		pack16(src, pkt.c.content16, samples); // interleave_net.h
+		bytes = samples * _outChans * BYTES_SAMPLE;
+	}
+	else // codec_net.h
+	{
+		pkt.hdr.format_bit = NET_FMT_COMPRESSED;
+		bytes = netEncode(_codec, src, _outChans, samples, _adpcm, pkt.c.content);
+		pkt.samplesUsed = bytes;	// see pktLength()
+	}
+	pkt.hdr.nuFrame = _nextFrame;
 	//if(printMe) printHdr(&pkt.hdr);
-	//if(printMe) Serial.printf("OUT chans %i, block ptrs 0x%04x 0x%04x\n", _outChans, block[0], block[1]);
+	//if(printMe)	printSamples(pkt.c.content16, samples, _outChans);
+	if(!_myQueueO.push(pkt, QPKT_HDR_SIZE + bytes)) // queue full, or out of slab space
+		didNotTransmit++;
+	else
+		etherTran.txReady(_myStreamO); // paced transmit sends it straight away
+	_nextFrame++;
+}
 
-	int16_t *dat = pkt.c.content16;
-	while(samplesProc < SAMPLES_BUF) // lots of channels --> 2 packets
+// frames are limited to what the codec's worst case fits in VBAN_MAX_DATA
+void AudioOutputNetBase::setCodec(netCodec codec)
+{
+	AudioNoInterrupts(); // update() may be building a frame
+	_codec = codec;
+	for(int i = 0; i < _outChans; i++)
+		_adpcm[i] = adpcmState();
+	_pktSamples = netCodecMaxSamples(codec, _outChans);
+	if(_frameSamples > _pktSamples)
+		_frameSamples = _pktSamples;
+	_stageSamples = 0;
+	AudioInterrupts();
+}
+
+int AudioOutputNetBase::setPacketSamples(int samples)
+{
+	if(samples > _pktSamples)
+		samples = _pktSamples;
+	if(samples < 0)
+		samples = 0;
+	int16_t *stage = _stage;
+	if(samples > 0 && stage == nullptr)
+	{
+		stage = (int16_t *)malloc(_outChans * NET_FRAME_MAX * sizeof(int16_t));
+		if(stage == nullptr)
+			return _frameSamples;
+	}
+	AudioNoInterrupts(); // update() may be filling a frame
+	_frameSamples = samples;
+	_stage = (samples > 0) ? stage : nullptr;
+	_stageSamples = 0;	// a part filled frame is dropped
+	AudioInterrupts();
+	if(samples == 0 && stage != nullptr)
+		free(stage);
+	return samples;
+}
+
+// 44100 sends the audio library's samples as they are. Other rates go through a rate converter
+bool AudioOutputNetBase::setSampleRate(uint32_t hz)
+{
+	int sr;
+	for(sr = 0; sr < VBAN_AUDIO_SR_MAXNUMBER; sr++)
+		if(VBAN_AUDIO_SRList[sr] == hz)
+			break;
+	if(sr == VBAN_AUDIO_SR_MAXNUMBER || (hz != 44100 && (hz < MIN_OUT_SAMPLE_RATE || hz > MAX_NET_SAMPLE_RATE)))
+		return false;
+	outConverter *conv = nullptr;
+	if(hz != 44100)
 	{
-		for(int j = 0; j < samplesPkt; j++)
+		conv = _conv;
+		if(conv == nullptr)
 		{
-			for(int i = 0; i < _outChans; i++)
+			int16_t *store = (int16_t *)malloc(_outChans * (RESAMPLE_BUF + OUT_CONV_SAMPLES) * sizeof(int16_t));
+			if(store == nullptr)
+				return false;
+			conv = new outConverter(store, _outChans);
+			if(conv == nullptr)
 			{
-				if(block[i] == nullptr)
-				{
-					*(dat + j * _outChans + i) = 0;
-				}
-				else
-				{		
-					int16_t *bdp = 	block[i]->data;
-					*(dat + j * _outChans + i) = *(bdp + samplesProc);
-				}
+				free(store);
+				return false;
 			}
-			samplesProc++;
 		}
-		//queue frame for transmit
-		//if(printMe)	printSamples(pkt.c.content16, samplesPkt, _outChans);
-		pkt.hdr.nuFrame = _nextFrame;
-		cli(); // may not be required - already in software interrupt
-			_myQueueO.push(pkt);
-		sei();
-		_nextFrame++;
-
-	} // while
+		if(conv != _conv)
+			conv->rs.reset();
+	}
+	AudioNoInterrupts(); // update() may be using the converter
+	if(conv != nullptr)
+		conv->rs.setRatio(AUDIO_SAMPLE_RATE_EXACT / hz);
+	outConverter *old = _conv;
+	_conv = conv;
+	_formatSR = VBAN_AUDIO_SHIFTED + sr;
+	_stageSamples = 0;	// don't mix rates in a frame
+	if(_myStreamO != EOQ)
+		etherTran.streamsOut[_myStreamO].hdr.format_SR = _formatSR;
+	AudioInterrupts();
+	if(old != nullptr && old != conv)
+	{
+		free(old->buf);
+		delete old;
+	}
 	return true;
 }
 
@@ -152,7 +293,7 @@ int subscribe(char *streamName, char *hostName) {}
  updateActiveStreams() should process these.
 */
 
-int AudioOutputNet::subscribe(char * sName, IPAddress remoteIP)
+int AudioOutputNetBase::subscribe(char * sName, IPAddress remoteIP)
 {
 	if(_myStreamO != EOQ) // already subscribed
 			return _myStreamO;
@@ -174,7 +315,9 @@ int AudioOutputNet::subscribe(char * sName, IPAddress remoteIP)
 		 strncpy(etherTran.streamsOut[emptySlot].hdr.streamname, sName, VBAN_STREAM_NAME_LENGTH-1);
 		 strncpy(_myStreamName, sName, VBAN_STREAM_NAME_LENGTH-1);
 		 etherTran.streamsOut[emptySlot].remoteIP = remoteIP;
-		 etherTran.streamsOut[emptySlot].hdr.format_SR = OK_VBAN_AUDIO_PROTO;
+		 etherTran.streamsOut[emptySlot].hdr.format_SR = _formatSR;
+		 etherTran.addDestination(&_dests, remoteIP);
+		 etherTran.destOut[emptySlot] = &_dests;
 		 etherTran.streamsOut[emptySlot].active = true;
 #ifdef ON_DEBUG
 		 Serial.printf("-~~~~-Subscribed Audio out to '%s', slot %i, IP ", sName, emptySlot);
@@ -186,7 +329,23 @@ int AudioOutputNet::subscribe(char * sName, IPAddress remoteIP)
 }
 
 
-int AudioOutputNet::missedTransmit(bool reset)
+// after subscribe()
+bool AudioOutputNetBase::addDestination(IPAddress remoteIP)
+{
+	if(_myStreamO == EOQ)
+		return false;
+	return etherTran.addDestination(&_dests, remoteIP);
+}
+
+bool AudioOutputNetBase::removeDestination(IPAddress remoteIP)
+{
+	if(_myStreamO == EOQ || !etherTran.removeDestination(&_dests, remoteIP))
+		return false;
+	etherTran.streamsOut[_myStreamO].remoteIP = _dests.dest[0].ip;	// reported by getStreamInfo()
+	return true;
+}
+
+int AudioOutputNetBase::missedTransmit(bool reset)
 {
 	int temp;
 	temp = didNotTransmit;
@@ -195,14 +354,14 @@ int AudioOutputNet::missedTransmit(bool reset)
 	return temp;
 }
 
-void AudioOutputNet::printHdr(vban_header *hdr)
+void AudioOutputNetBase::printHdr(vban_header *hdr)
 {
 #ifdef ON_DEBUG
 			Serial.printf("ON: Hdr: '%c' proto+rate 0x%02X, samples %i, chans %i fmt_bit 0x%02X, '%s' fr %i\n", (char)hdr->vban, hdr->format_SR, hdr->format_nbs +1, hdr->format_nbc +1, hdr->format_bit, hdr->streamname, hdr->nuFrame);
 #endif
 }
 
-void AudioOutputNet::printSamples(int16_t *buff, int samps, int chans)
+void AudioOutputNetBase::printSamples(int16_t *buff, int samps, int chans)
 {
 #ifdef ON_DEBUG
 		int i;	
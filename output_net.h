@@ -15,6 +15,9 @@
 #include "Audio.h"
 #include "audio_net.h"
 #include "control_ethernet.h"
+#include "resample_net.h"
+#include "interleave_net.h"
+#include "codec_net.h"
 
 //#define ON_DEBUG
 
@@ -25,28 +28,63 @@
  */
 
 #define DEFAULT_CHANNELS 2
+#define OUT_CONV_SAMPLES	(AUDIO_BLOCK_SAMPLES * MAX_NET_SAMPLE_RATE / 44100 + 2)	// converted samples per update(), at most
 
-class AudioOutputNet : public AudioStream
+// samples per packet at most: VBAN_MAX_DATA bytes, 256 samples
+constexpr int outPktSamples(int chans) { return (VBAN_MAX_DATA / (chans * BYTES_SAMPLE) > 256) ? 256 : VBAN_MAX_DATA / (chans * BYTES_SAMPLE); }
+
+// rate conversion for streams not sent at the audio library's rate. Allocated by setSampleRate(), sized for the channels
+struct outConverter
+{
+	outConverter(int16_t *store, int chans) : rs(store, chans), buf(store) {}
+	Resampler rs;
+	int16_t *buf;	// rs history [chans][RESAMPLE_BUF], then output [chans][OUT_CONV_SAMPLES]
+};
+
+// All of the output's work. Buffers are owned by AudioOutputNetT<N> (exact size) or AudioOutputNet (MAXCHANNELS)
+class AudioOutputNetBase : public AudioStream
 {
 public:
-	AudioOutputNet(uint8_t outCh = DEFAULT_CHANNELS) : AudioStream(outCh, inputQueueArray) 
-	{
-		_outChans = outCh;
-		}
 	friend class AudioControlEthernet; // may not be required
 	
 	void begin(void);	
 	void update(void);
 
-	int subscribe(char *sName, IPAddress remoteIP = IPAddress((uint32_t)0)); // default to broadcast IP
+	int subscribe(char *sName, IPAddress remoteIP = IPAddress((uint32_t)0)); // default to broadcast IP. May be a multicast group (etherTran.getGroupIP())
 	// int subscribe(char *streamName, char *hostName) is not yet implemented
+	// more destinations for the subscribed stream (up to MAX_DESTINATIONS, including subscribe()'s). Packets are built once and sent to each
+	bool addDestination(IPAddress remoteIP);
+	bool removeDestination(IPAddress remoteIP);	// the last one can't be removed
+	int destinations(void) { return _dests.count; }
+	netDest getDestination(int d) { return (d >= 0 && d < _dests.count) ? _dests.dest[d] : netDest(); }	// address and packet counts
 	int missedTransmit(bool reset = true);	// get (and reset) the number of missed transmit buffer on update
+	uint32_t queueBytes(void) { return _myQueueO.bytesUsed(); }	// queue memory in use
+	bool setSampleRate(uint32_t hz);	// 44100 (default, unconverted), 48000 or another VBAN rate from MIN_OUT_SAMPLE_RATE to MAX_NET_SAMPLE_RATE
+
+	// packetizer: samples per VBAN frame. 0 (default): each update() is sent straight away, split if it won't fit one frame
+	// Otherwise blocks are gathered into frames of this many samples (at most 256, or what fits VBAN_MAX_DATA with the codec: call setCodec() first),
+	// fewer packets for up to one frame more latency
+	int setPacketSamples(int samples);	// returns the size used
+	int packetSamples(void) { return _frameSamples; }
+
+	// NET_CODEC_PCM (default): plain VBAN. NET_CODEC_ADPCM or NET_CODEC_LOSSLESS: compressed frames (codec_net.h),
+	// only for AudioInputNet objects that have called setCompressed(true)
+	void setCodec(netCodec codec);
 
 protected:
+	AudioOutputNetBase(int outCh, audio_block_t **queueArray, audio_block_t **blocks) : AudioStream(outCh, queueArray),
+		block(blocks), _outChans(outCh), _pktSamples(outPktSamples(outCh)) {}
+
+	// n samples from each src[ch] (nullptr: silence) to an interleaved packet
+	virtual void pack16(const int16_t * const *src, int16_t *dst, int n)
+	{
+		interleave16(src, _outChans, dst, n);
+	}
+
 	bool queueBlocks(void);
-	audio_block_t *inputQueueArray[MAXCHANNELS];
-	audio_block_t *block[MAXCHANNELS];	
-	std::queue <queuePkt> _myQueueO;
+	void sendFrame(const int16_t * const *src, int samples);
+	audio_block_t **block;	// [_outChans]
+	pktQueue _myQueueO;
 	int _myStreamO = EOQ; // valid streamID is 0..255
 
 private:
@@ -55,10 +93,49 @@ private:
 	uint32_t didNotTransmit = 0;
 	uint32_t _nextFrame = 0; 
 	uint8_t _outChans;
+	int _pktSamples;	// largest packet
+	uint8_t _formatSR = OK_VBAN_AUDIO_PROTO;
+	outConverter *_conv = nullptr;	// nullptr: sent at the audio library's rate
+	int _frameSamples = 0;				// packetizer: 0 - one update() per frame
+	int16_t *_stage = nullptr;		// frame being filled: [_outChans][NET_FRAME_MAX]. Allocated by setPacketSamples()
+	int _stageSamples = 0;
+	netCodec _codec = NET_CODEC_PCM;
+	adpcmState _adpcm[MAXCHANNELS];
+	destList _dests;
 
 	// debug 
 	bool printMe;
 	void printHdr(vban_header *hdr);
 	void printSamples(int16_t *buff, int len, int chans);
 };
+
+// N channels, fixed at compile time: block pointers are sized for N and packets are built by the unrolled kernel
+template <int N> class AudioOutputNetT : public AudioOutputNetBase
+{
+	static_assert(N >= 1 && N <= MAXCHANNELS, "AudioOutputNetT: 1 to MAXCHANNELS channels");
+public:
+	AudioOutputNetT() : AudioOutputNetBase(N, inputQueueArray, _blocks) {}
+	static constexpr int channels = N;
+	static constexpr int pktSamples = outPktSamples(N);
+	static constexpr int pktsPerBlock = (AUDIO_BLOCK_SAMPLES + pktSamples - 1) / pktSamples;	// at 44.1kHz
+	static_assert((N >= CHANS_2_PKTS) == (pktsPerBlock == 2), "CHANS_2_PKTS doesn't match VBAN_MAX_DATA");
+
+protected:
+	void pack16(const int16_t * const *src, int16_t *dst, int n) override { interleave16T<N>(src, dst, n); }
+
+private:
+	audio_block_t *inputQueueArray[N];
+	audio_block_t *_blocks[N];
+};
+
+// channels chosen at run time, up to MAXCHANNELS
+class AudioOutputNet : public AudioOutputNetBase
+{
+public:
+	AudioOutputNet(uint8_t outCh = DEFAULT_CHANNELS) : AudioOutputNetBase((outCh > MAXCHANNELS) ? MAXCHANNELS : outCh, inputQueueArray, _blocks) {}
+
+private:
+	audio_block_t *inputQueueArray[MAXCHANNELS];
+	audio_block_t *_blocks[MAXCHANNELS];
+};
 #endif
@@ -0,0 +1,75 @@
+/* Receive packet buffer pool for the Teensy Ethernet Audio Library
+ *
+ * Incoming datagrams are copied once, from the network stack into a pool slot.
+ * Input queues carry only the slot pointer (a pktHandle), so consumers read samples straight from the slot.
+ *
+ * alloc() is only called from updateNet(). release() may be called from any context (update() or user code):
+ * a slot becomes free when its flag is cleared with release ordering, after the consumer has finished with it.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _PKT_POOL_H_
+#define _PKT_POOL_H_
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, int N>
+class PktPool
+{
+public:
+	PktPool() { for(int i = 0; i < N; i++) _used[i].store(false, std::memory_order_relaxed); }
+
+	void begin(T *slots) { _slots = slots; }	// storage is provided by the owner, so it can be placed in DMAMEM
+
+	// single allocator (updateNet). Starts where the last search finished, so normally finds a free slot first time.
+	T *alloc(void)
+	{
+		if(_slots == nullptr)
+			return nullptr;
+		for(int n = 0; n < N; n++)
+		{
+			int i = _next;
+			_next = (_next + 1 == N) ? 0 : _next + 1;
+			if(!_used[i].load(std::memory_order_acquire))
+			{
+				_used[i].store(true, std::memory_order_relaxed);
+				return &_slots[i];
+			}
+		}
+		_exhausted++;
+		return nullptr;
+	}
+
+	// any context
+	void release(T *slot)
+	{
+		if(slot == nullptr || _slots == nullptr)
+			return;
+		int i = slot - _slots;
+		if(i >= 0 && i < N)
+			_used[i].store(false, std::memory_order_release);
+	}
+
+	int inUse(void) const
+	{
+		int count = 0;
+		for(int i = 0; i < N; i++)
+			if(_used[i].load(std::memory_order_relaxed))
+				count++;
+		return count;
+	}
+	uint32_t exhausted(void) const { return _exhausted; }	// allocations that failed: packet dropped
+	static constexpr int size(void) { return N; }
+
+private:
+	T *_slots = nullptr;
+	std::atomic<bool> _used[N];
+	int _next = 0;
+	uint32_t _exhausted = 0;
+};
+
+#endif
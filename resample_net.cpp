@@ -0,0 +1,160 @@
+/* Fractional sample rate converter for AudioInputNet
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "resample_net.h"
+
+#define RS_TABLE_LEN ((RS_PHASES + 1) * RS_TAPS)
+
+// shared coefficient tables. Cutoffs are quantised to 1/64 so that drift doesn't create new ones
+static float rsTables[RS_TABLES][RS_TABLE_LEN];
+static int rsTableKey[RS_TABLES] = {0};	// cutoff * 64, 0: unused
+
+// tab[ph][t] is the tap for input sample (t - RS_HALF + 1) relative to an output ph/RS_PHASES past it
+static void makeTable(float *tab, float cutoff)
+{
+	for(int ph = 0; ph <= RS_PHASES; ph++)
+	{
+		float *c = tab + ph * RS_TAPS;
+		float sum = 0;
+		for(int t = 0; t < RS_TAPS; t++)
+		{
+			float x = (float)(t - RS_HALF + 1) - (float)ph / RS_PHASES;
+			float u = x / RS_HALF;
+			float w = (u <= -1.0f || u >= 1.0f) ? 0 : 0.42f + 0.5f * cosf((float)M_PI * u) + 0.08f * cosf(2.0f * (float)M_PI * u); // Blackman
+			float s = (x == 0) ? 1.0f : sinf((float)M_PI * cutoff * x) / ((float)M_PI * cutoff * x);
+			c[t] = s * w;
+			sum += c[t];
+		}
+		for(int t = 0; t < RS_TAPS; t++) // unity gain at DC
+			c[t] /= sum;
+	}
+}
+
+const float *Resampler::table(float cutoff)
+{
+	int key = (int)(cutoff * 64);
+	int slot = EOQ;
+	for(int i = 0; i < RS_TABLES; i++)
+	{
+		if(rsTableKey[i] == key)
+			return rsTables[i];
+		if(rsTableKey[i] == 0 && slot == EOQ)
+			slot = i;
+	}
+	if(slot == EOQ) // all in use: nearest existing cutoff
+	{
+		slot = 0;
+		for(int i = 1; i < RS_TABLES; i++)
+			if(abs(rsTableKey[i] - key) < abs(rsTableKey[slot] - key))
+				slot = i;
+		return rsTables[slot];
+	}
+	makeTable(rsTables[slot], (float)key / 64);
+	rsTableKey[slot] = key;
+	return rsTables[slot];
+}
+
+// RS_HALF - 1 samples of silence ahead of the first input
+void Resampler::reset(void)
+{
+	memset(_buf, 0, _channels * RESAMPLE_BUF * sizeof(int16_t));
+	_avail = RS_HALF - 1;
+	_pos = RS_HALF - 1;
+}
+
+bool Resampler::setRatio(double ratio)
+{
+	if(ratio <= 0 || ratio > RS_MAX_RATIO)
+		return false;
+	_ratio = ratio;
+	float cutoff = (ratio > 1.0) ? RS_PASSBAND / (float)ratio : RS_PASSBAND;
+	if(_tab == nullptr || (int)(cutoff * 64) != (int)(_cutoff * 64))
+	{
+		_tab = table(cutoff);
+		_cutoff = cutoff;
+	}
+	return true;
+}
+
+int Resampler::inputNeeded(int nOut)
+{
+	int last = (int)(_pos + (nOut - 1) * _ratio);	// input sample at or before the last output
+	int n = last + RS_HALF + 1 - _avail;
+	if(n < 0)
+		n = 0;
+	if(n > RESAMPLE_BUF - _avail)
+		n = RESAMPLE_BUF - _avail;
+	return n;
+}
+
+int Resampler::outputAvailable(void)
+{
+	double span = _avail - RS_HALF - 1 - _pos;	// the last output may be this far past the next one
+	return (span < 0) ? 0 : (int)(span / _ratio) + 1;
+}
+
+void Resampler::input(int16_t **ptrs, int channels)
+{
+	for(int ch = 0; ch < channels && ch < _channels; ch++)
+		ptrs[ch] = _buf + ch * RESAMPLE_BUF + _avail;
+}
+
+void Resampler::commit(int n)
+{
+	_avail += n;
+	if(_avail > RESAMPLE_BUF)
+		_avail = RESAMPLE_BUF;
+}
+
+void Resampler::process(int16_t * const *out, int channels, int nOut)
+{
+	if(channels > _channels)
+		channels = _channels;
+	float c[RS_TAPS];
+	for(int k = 0; k < nOut; k++)
+	{
+		double p = _pos + k * _ratio;
+		int i = (int)p;
+		float f = (float)(p - i) * RS_PHASES;
+		int ph = (int)f;
+		f -= ph;
+		const float *a = _tab + ph * RS_TAPS;
+		const float *b = a + RS_TAPS;
+		for(int t = 0; t < RS_TAPS; t++)
+			c[t] = a[t] + (b[t] - a[t]) * f;
+		int first = i - RS_HALF + 1;
+		if(first + RS_TAPS > _avail) // starved: the caller didn't supply inputNeeded()
+			first = (_avail > RS_TAPS) ? _avail - RS_TAPS : 0;
+		for(int ch = 0; ch < channels; ch++)
+		{
+			const int16_t *in = _buf + ch * RESAMPLE_BUF + first;
+			float acc = 0;
+			for(int t = 0; t < RS_TAPS; t++)
+				acc += c[t] * in[t];
+			int32_t s = (int32_t)lrintf(acc);
+			out[ch][k] = (s > 32767) ? 32767 : (s < -32768) ? -32768 : (int16_t)s;
+		}
+	}
+	// keep the history the next block's first output needs
+	_pos += nOut * _ratio;
+	int drop = (int)_pos - (RS_HALF - 1);
+	if(drop > _avail)
+		drop = _avail;
+	if(drop > 0)
+	{
+		for(int ch = 0; ch < channels; ch++)
+		{
+			int16_t *b = _buf + ch * RESAMPLE_BUF;
+			memmove(b, b + drop, (_avail - drop) * sizeof(int16_t));
+		}
+		_avail -= drop;
+		_pos -= drop;
+	}
+}
@@ -0,0 +1,63 @@
+/* Fractional sample rate converter for AudioInputNet
+ *
+ * Windowed sinc interpolation: RS_TAPS taps, with coefficients for RS_PHASES fractional positions and linear interpolation between them.
+ * The ratio (input samples per output sample) may change every block, so the same converter follows clock drift
+ * and converts between nominal rates. Below unity the cutoff follows the ratio, so downsampling doesn't alias.
+ * Coefficient tables are shared by all converters with the same cutoff.
+ * Sample history (channels * RESAMPLE_BUF) is provided by the owner, sized for its channel count.
+ *
+ * Per block, for a fixed output (inputs):
+ *	n = inputNeeded(AUDIO_BLOCK_SAMPLES);
+ *	input(ptrs);					// write n samples per channel at ptrs[ch]
+ *	commit(n);
+ *	process(out, channels, AUDIO_BLOCK_SAMPLES);
+ * or for a fixed input (outputs): input(), commit(AUDIO_BLOCK_SAMPLES), then process(out, channels, outputAvailable()).
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _RESAMPLE_NET_H_
+#define _RESAMPLE_NET_H_
+
+#include <stdint.h>
+#include "audio_net.h"
+
+#define RS_HALF				8			// taps each side of the output position
+#define RS_TAPS				(RS_HALF * 2)
+#define RS_PHASES			32
+#define RS_PASSBAND		0.92f	// cutoff, as a fraction of the lower Nyquist frequency
+#define RS_MAX_RATIO	2.2		// 96 kHz into 44.1 kHz, with room for drift
+#define RS_TABLES			4			// different cutoffs in use at once
+
+static_assert(RS_TAPS + (int)(AUDIO_BLOCK_SAMPLES * RS_MAX_RATIO) + 2 <= RESAMPLE_BUF, "RESAMPLE_BUF is too small for RS_MAX_RATIO");
+
+class Resampler
+{
+public:
+	Resampler(int16_t *buf, int channels) : _channels(channels), _buf(buf) { reset(); setRatio(1.0); }
+
+	void reset(void);							// discard history: the next output starts with silence
+	bool setRatio(double ratio);	// input samples per output sample. false: out of range, unchanged
+	double ratio(void) { return _ratio; }
+
+	int inputNeeded(int nOut);		// samples (per channel) to commit() before process(nOut)
+	int outputAvailable(void);		// outputs process() can make from the samples committed so far
+	void input(int16_t **ptrs, int channels);	// where the next samples go
+	void commit(int n);
+	void process(int16_t * const *out, int channels, int nOut);
+
+private:
+	const float *table(float cutoff);
+
+	double _ratio = 1.0;
+	double _pos;						// position of the next output in _buf
+	int _avail;							// samples in _buf
+	float _cutoff = 0;
+	const float *_tab = nullptr;
+	int _channels;
+	int16_t *_buf;					// [_channels][RESAMPLE_BUF]
+};
+
+#endif
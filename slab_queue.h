@@ -0,0 +1,109 @@
+/* Variable length, single-producer / single-consumer FIFO for outgoing packets
+ *
+ * Records are stored back to back in a fixed slab, each taking only its real length (rounded up to a word) plus a one word length prefix.
+ * A record never wraps: if it won't fit before the end of the slab, a wrap marker is written and it starts again at the beginning.
+ * push() and pop() are O(1). The same producer / consumer rules as SPSCQueue (spsc_queue.h) apply:
+ *	update() (or user code for service outputs) pushes, updateNet() or paceTx() pops.
+ *
+ * T is the record type. front() returns a T whose first frontLen() bytes are valid.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _SLAB_QUEUE_H_
+#define _SLAB_QUEUE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+template <typename T, uint32_t BYTES>
+class SlabQueue
+{
+	static constexpr uint32_t W = BYTES / 4;		// slab size in words
+	static constexpr uint32_t WRAP = 0xFFFFFFFF;	// rest of the slab is unused, next record is at 0
+	static_assert(W >= (sizeof(T) + 3) / 4 + 2, "SlabQueue: slab must hold at least one full sized record");
+	static_assert(alignof(T) <= 4, "SlabQueue: records are word aligned");
+
+public:
+	SlabQueue() : _head(0), _tail(0), _pushed(0), _popped(0) { }
+
+	// producer side
+	bool push(const T &item, uint32_t len)	// copy the first len bytes of item. False (and not queued) when there is no room
+	{
+		if(len == 0 || len > sizeof(T))
+			return false;
+		uint32_t need = 1 + words(len);
+		uint32_t h = _head.load(std::memory_order_relaxed);
+		uint32_t t = _tail.load(std::memory_order_acquire);
+		uint32_t at = h;
+		if(h >= t)
+		{
+			// one word is always left free, so that head == tail only when empty
+			if(need > W - h - ((t == 0) ? 1 : 0))
+			{
+				if(need >= t) // won't fit at the start either
+					return false;
+				_slab[h] = WRAP;
+				at = 0;
+			}
+		}
+		else if(need >= t - h)
+			return false;
+		_slab[at] = len;
+		memcpy((void *)&_slab[at + 1], (const void *)&item, len);
+		at += need;
+		_head.store((at >= W) ? 0 : at, std::memory_order_release);
+		_pushed.store(_pushed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer side. Only valid if !empty()
+	T &front(void)
+	{
+		return *(T *)&_slab[first() + 1];
+	}
+	uint32_t frontLen(void)
+	{
+		return _slab[first()];
+	}
+	void pop(void)
+	{
+		uint32_t t = _tail.load(std::memory_order_relaxed);
+		if(t == _head.load(std::memory_order_acquire))
+			return;
+		t = first();
+		t += 1 + words(_slab[t]);
+		_tail.store((t >= W) ? 0 : t, std::memory_order_release);
+		_popped.store(_popped.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// either side
+	uint32_t size(void) const { return _pushed.load(std::memory_order_acquire) - _popped.load(std::memory_order_acquire); }	// records
+	bool empty(void) const { return size() == 0; }
+	uint32_t bytesUsed(void) const	// including length words and any space skipped at a wrap
+	{
+		uint32_t h = _head.load(std::memory_order_acquire);
+		uint32_t t = _tail.load(std::memory_order_acquire);
+		return ((h >= t) ? h - t : h + W - t) * 4;
+	}
+	static constexpr uint32_t capacityBytes(void) { return W * 4; }
+
+private:
+	static uint32_t words(uint32_t len) { return (len + 3) / 4; }
+	uint32_t first(void)	// tail, skipping a wrap marker
+	{
+		uint32_t t = _tail.load(std::memory_order_relaxed);
+		return (_slab[t] == WRAP) ? 0 : t;
+	}
+
+	std::atomic<uint32_t> _head;		// next word to write (producer owned)
+	std::atomic<uint32_t> _tail;		// next record to read (consumer owned)
+	std::atomic<uint32_t> _pushed;	// record counts, for size()
+	std::atomic<uint32_t> _popped;
+	uint32_t _slab[W];
+};
+
+#endif
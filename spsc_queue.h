@@ -0,0 +1,67 @@
+/* Fixed capacity, single-producer / single-consumer FIFO for network packet queues
+ *
+ * Storage is part of the object: no heap allocation, so it is safe to push or pop from the audio update() interrupt.
+ * One context may push() and one other context may front()/pop() without masking interrupts:
+ *	inputs:  updateNet() pushes, update() (or user code for service inputs) pops
+ *	outputs: update() (or user code for service outputs) pushes, updateNet() pops
+ * The producer publishes _head with release ordering after the slot is written,
+ * the consumer publishes _tail with release ordering after the slot has been read.
+ * Indices run 0..2N-1 so that full (N) and empty (0) can be told apart without a spare slot.
+ *
+ * Richard Palmer 2024
+ * Released under GNU Affero General Public License v3.0 or later
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _SPSC_QUEUE_H_
+#define _SPSC_QUEUE_H_
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint32_t N>
+class SPSCQueue
+{
+public:
+	SPSCQueue() : _head(0), _tail(0) { }
+
+	// producer side
+	bool push(const T &item)	// false (and item not queued) when full
+	{
+		uint32_t head = _head.load(std::memory_order_relaxed);
+		if(fill(head, _tail.load(std::memory_order_acquire)) >= N)
+			return false;
+		_buf[slot(head)] = item;
+		_head.store(next(head), std::memory_order_release);
+		return true;
+	}
+
+	// consumer side
+	T &front(void)	// only valid if !empty()
+	{
+		return _buf[slot(_tail.load(std::memory_order_relaxed))];
+	}
+	void pop(void)
+	{
+		uint32_t tail = _tail.load(std::memory_order_relaxed);
+		if(tail != _head.load(std::memory_order_acquire))
+			_tail.store(next(tail), std::memory_order_release);
+	}
+
+	// either side
+	uint32_t size(void) const { return fill(_head.load(std::memory_order_acquire), _tail.load(std::memory_order_acquire)); }
+	bool empty(void) const { return size() == 0; }
+	uint32_t space(void) const { return N - size(); }
+	static constexpr uint32_t capacity(void) { return N; }
+
+private:
+	static uint32_t next(uint32_t i) { return (i + 1 == 2 * N) ? 0 : i + 1; }
+	static uint32_t slot(uint32_t i) { return (i < N) ? i : i - N; }
+	static uint32_t fill(uint32_t head, uint32_t tail) { return (head >= tail) ? head - tail : head + 2 * N - tail; }
+
+	std::atomic<uint32_t> _head;	// next slot to write (producer owned)
+	std::atomic<uint32_t> _tail;	// next slot to read (consumer owned)
+	T _buf[N];
+};
+
+#endif